@@ -0,0 +1,601 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+// Headless throughput benchmark for the 'brlcad' module: builds a synthetic
+// CSG database with libwdb (or uses an existing one), commits a 'brlcad'
+// geometry and drives its Embree callbacks directly at every ray packet
+// width and a range of thread counts, reporting the results as JSON.
+
+#include "ospray/ospray.h"
+#include "ospray/common/Model.h"
+#include "ospray/geometry/Geometry.h"
+#include "ospray/api/ISPCDevice.h"
+
+#include "ospcommon/vec.h"
+#include "ospcommon/box.h"
+#include "ospcommon/library.h"
+
+#include "embree2/rtcore.h"
+#include "embree2/rtcore_ray.h"
+
+#undef UNUSED
+#undef _USE_MATH_DEFINES
+#include "brlcad/common.h"
+#include "brlcad/vmath.h"		/* vector math macros */
+#include "brlcad/wdb.h"		/* libwdb, to write the synthetic database */
+
+#include "moduleAPI.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ospray {
+  namespace brlcad {
+
+    using namespace ospcommon;
+
+    std::string filename;
+    std::string objects = "all";
+    std::string outputFile;
+
+    int  numRegions       = 1000;
+    int  booleanDepth     = 3;
+    int  numRays          = 1 << 20;
+    int  maxThreads       = std::max(1u, std::thread::hardware_concurrency());
+    bool regionPrimitives = false;
+    bool hybrid           = false;
+    bool keepDatabase     = false;
+
+    // Synthetic database /////////////////////////////////////////////////////
+
+    /*! Write 'regions' regions on a grid into a new .g file, each a sphere
+        carved by 'depth' further boolean operations (cycling through
+        subtraction, intersection and union), plus one top-level 'all'
+        combination of every region */
+    void generateDatabase(const std::string &path, int regions, int depth)
+    {
+      std::remove(path.c_str());
+
+      auto *fp = wdb_fopen(path.c_str());
+      if (fp == nullptr)
+        throw std::runtime_error("Could not create " + path);
+
+      mk_id(fp, "ospBrlcadBench synthetic scene");
+
+      const int    side    = std::max(1, int(std::ceil(std::cbrt(regions))));
+      const double spacing = 100.0;
+      const double radius  = 40.0;
+
+      wmember all;
+      BU_LIST_INIT(&all.l);
+
+      for (int i = 0; i < regions; ++i) {
+        const std::string name = "r" + std::to_string(i);
+
+        point_t center;
+        VSET(center,
+             spacing * (i % side),
+             spacing * ((i / side) % side),
+             spacing * (i / (side * side)));
+
+        wmember members;
+        BU_LIST_INIT(&members.l);
+
+        const std::string base = name + ".s0";
+        mk_sph(fp, base.c_str(), center, radius);
+        mk_addmember(base.c_str(), &members.l, nullptr, WMOP_UNION);
+
+        for (int d = 1; d <= depth; ++d) {
+          const std::string prim = name + ".s" + std::to_string(d);
+
+          // spread the operands over the sphere (golden angle spiral)
+          const double z   = 1.0 - 2.0 * (d - 0.5) / depth;
+          const double r   = std::sqrt(std::max(0.0, 1.0 - z * z));
+          const double phi = d * 2.399963229728653;
+          vect_t offset;
+          VSET(offset, r * std::cos(phi), r * std::sin(phi), z);
+
+          switch (d % 3) {
+          case 1: {
+            // dent: subtract a small sphere centered on the surface
+            point_t c;
+            VJOIN1(c, center, radius, offset);
+            mk_sph(fp, prim.c_str(), c, 0.3 * radius);
+            mk_addmember(prim.c_str(), &members.l, nullptr, WMOP_SUBTRACT);
+          } break;
+          case 2: {
+            // slice: intersect with a box slightly smaller than the sphere
+            point_t lo, hi;
+            const double h = (0.95 - 0.02 * d) * radius;
+            VSET(lo, center[X] - h, center[Y] - h, center[Z] - h);
+            VSET(hi, center[X] + h, center[Y] + h, center[Z] + h);
+            mk_rpp(fp, prim.c_str(), lo, hi);
+            mk_addmember(prim.c_str(), &members.l, nullptr, WMOP_INTERSECT);
+          } break;
+          default: {
+            // boss: union a short cylinder sticking out of the surface
+            vect_t height;
+            VSCALE(height, offset, 0.4 * radius);
+            point_t base;
+            VJOIN1(base, center, 0.8 * radius, offset);
+            mk_rcc(fp, prim.c_str(), base, height, 0.15 * radius);
+            mk_addmember(prim.c_str(), &members.l, nullptr, WMOP_UNION);
+          } break;
+          }
+        }
+
+        unsigned char rgb[3] = {
+          (unsigned char)(64 + (i * 37) % 192),
+          (unsigned char)(64 + (i * 91) % 192),
+          (unsigned char)(64 + (i * 53) % 192)
+        };
+
+        mk_lcomb(fp, name.c_str(), &members, 1, "plastic", "", rgb, 0);
+        mk_addmember(name.c_str(), &all.l, nullptr, WMOP_UNION);
+      }
+
+      mk_lcomb(fp, "all", &all, 0, nullptr, nullptr, nullptr, 0);
+
+      wdb_close(fp);
+    }
+
+    // Rays ///////////////////////////////////////////////////////////////////
+
+    struct BenchRay
+    {
+      vec3f org;
+      vec3f dir;
+    };
+
+    /*! Deterministic rays from a sphere around 'bounds' towards random points
+        inside it, so most (but not all) of them hit something */
+    std::vector<BenchRay> generateRays(const box3f &bounds, int count)
+    {
+      std::mt19937 rng(0x0b5c4d);
+      std::uniform_real_distribution<float> uniform(0.f, 1.f);
+
+      const vec3f center = ospcommon::center(bounds);
+      const float radius = 0.75f * length(bounds.size()) + 1.f;
+
+      std::vector<BenchRay> rays(count);
+      for (auto &ray : rays) {
+        const float z   = 1.f - 2.f * uniform(rng);
+        const float r   = std::sqrt(std::max(0.f, 1.f - z * z));
+        const float phi = 2.f * float(M_PI) * uniform(rng);
+
+        const vec3f target(bounds.lower.x + uniform(rng) * bounds.size().x,
+                           bounds.lower.y + uniform(rng) * bounds.size().y,
+                           bounds.lower.z + uniform(rng) * bounds.size().z);
+
+        ray.org = center + radius * vec3f(r * std::cos(phi),
+                                          r * std::sin(phi),
+                                          z);
+        ray.dir = normalize(target - ray.org);
+      }
+
+      return rays;
+    }
+
+    // Packet tracing /////////////////////////////////////////////////////////
+
+    inline void intersect(const int *v, RTCScene s, RTCRay4 &r)
+    { rtcIntersect4(v, s, r); }
+    inline void intersect(const int *v, RTCScene s, RTCRay8 &r)
+    { rtcIntersect8(v, s, r); }
+    inline void intersect(const int *v, RTCScene s, RTCRay16 &r)
+    { rtcIntersect16(v, s, r); }
+
+    inline void occluded(const int *v, RTCScene s, RTCRay4 &r)
+    { rtcOccluded4(v, s, r); }
+    inline void occluded(const int *v, RTCScene s, RTCRay8 &r)
+    { rtcOccluded8(v, s, r); }
+    inline void occluded(const int *v, RTCScene s, RTCRay16 &r)
+    { rtcOccluded16(v, s, r); }
+
+    /*! Trace rays [begin, end) one at a time; returns the number of hits */
+    size_t traceScalar(RTCScene scene,
+                       const std::vector<BenchRay> &rays,
+                       size_t begin,
+                       size_t end,
+                       bool occlusion)
+    {
+      size_t hits = 0;
+
+      for (size_t i = begin; i < end; ++i) {
+        RTCRay ray;
+        ray.org[0] = rays[i].org.x;
+        ray.org[1] = rays[i].org.y;
+        ray.org[2] = rays[i].org.z;
+        ray.dir[0] = rays[i].dir.x;
+        ray.dir[1] = rays[i].dir.y;
+        ray.dir[2] = rays[i].dir.z;
+        ray.tnear  = 0.f;
+        ray.tfar   = inf;
+        ray.time   = 0.f;
+        ray.mask   = -1;
+        ray.geomID = RTC_INVALID_GEOMETRY_ID;
+        ray.primID = RTC_INVALID_GEOMETRY_ID;
+        ray.instID = RTC_INVALID_GEOMETRY_ID;
+
+        if (occlusion) {
+          rtcOccluded(scene, ray);
+          hits += ray.geomID == 0;
+        } else {
+          rtcIntersect(scene, ray);
+          hits += ray.geomID != RTC_INVALID_GEOMETRY_ID;
+        }
+      }
+
+      return hits;
+    }
+
+    /*! Trace rays [begin, end) in packets of N; returns the number of hits */
+    template<typename RayN, int N>
+    size_t tracePackets(RTCScene scene,
+                        const std::vector<BenchRay> &rays,
+                        size_t begin,
+                        size_t end,
+                        bool occlusion)
+    {
+      size_t hits = 0;
+
+      for (size_t first = begin; first < end; first += N) {
+        alignas(64) int valid[N];
+        alignas(64) RayN packet;
+
+        for (int j = 0; j < N; ++j) {
+          const size_t i = first + j;
+          valid[j] = i < end ? -1 : 0;
+
+          const auto &ray = rays[std::min(i, end - 1)];
+          packet.orgx[j]   = ray.org.x;
+          packet.orgy[j]   = ray.org.y;
+          packet.orgz[j]   = ray.org.z;
+          packet.dirx[j]   = ray.dir.x;
+          packet.diry[j]   = ray.dir.y;
+          packet.dirz[j]   = ray.dir.z;
+          packet.tnear[j]  = 0.f;
+          packet.tfar[j]   = inf;
+          packet.time[j]   = 0.f;
+          packet.mask[j]   = -1;
+          packet.geomID[j] = RTC_INVALID_GEOMETRY_ID;
+          packet.primID[j] = RTC_INVALID_GEOMETRY_ID;
+          packet.instID[j] = RTC_INVALID_GEOMETRY_ID;
+        }
+
+        if (occlusion)
+          occluded(valid, scene, packet);
+        else
+          intersect(valid, scene, packet);
+
+        for (int j = 0; j < N; ++j) {
+          if (!valid[j])
+            continue;
+          hits += occlusion ? packet.geomID[j] == 0
+                            : packet.geomID[j] != RTC_INVALID_GEOMETRY_ID;
+        }
+      }
+
+      return hits;
+    }
+
+    struct RunResult
+    {
+      std::string query;
+      int width;
+      int threads;
+      double seconds;
+      size_t hits;
+    };
+
+    /*! Trace all rays with 'threads' threads pulling blocks of rays */
+    RunResult run(RTCScene scene,
+                  const std::vector<BenchRay> &rays,
+                  int width,
+                  int threads,
+                  bool occlusion)
+    {
+      static constexpr size_t BLOCK_SIZE = 256;
+
+      std::atomic<size_t> nextBlock {0};
+      std::atomic<size_t> hits {0};
+
+      auto worker = [&]() {
+        size_t localHits = 0;
+        for (;;) {
+          const size_t begin = nextBlock.fetch_add(BLOCK_SIZE);
+          if (begin >= rays.size())
+            break;
+          const size_t end = std::min(begin + BLOCK_SIZE, rays.size());
+
+          switch (width) {
+          case 4:
+            localHits += tracePackets<RTCRay4, 4>(scene, rays, begin, end,
+                                                  occlusion);
+            break;
+          case 8:
+            localHits += tracePackets<RTCRay8, 8>(scene, rays, begin, end,
+                                                  occlusion);
+            break;
+          case 16:
+            localHits += tracePackets<RTCRay16, 16>(scene, rays, begin, end,
+                                                    occlusion);
+            break;
+          default:
+            localHits += traceScalar(scene, rays, begin, end, occlusion);
+          }
+        }
+        hits += localHits;
+      };
+
+      const auto start = std::chrono::steady_clock::now();
+
+      std::vector<std::thread> pool;
+      for (int t = 0; t < threads; ++t)
+        pool.emplace_back(worker);
+      for (auto &thread : pool)
+        thread.join();
+
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+      return {occlusion ? "occluded" : "intersect",
+              width, threads, elapsed.count(), hits.load()};
+    }
+
+    /*! Peak resident set size of this process in bytes */
+    size_t peakRSS()
+    {
+      rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      return size_t(usage.ru_maxrss) * 1024;
+    }
+
+    // Main ///////////////////////////////////////////////////////////////////
+
+    static inline void printUsage()
+    {
+      std::cerr << "usage: ospBrlcadBench [options]\n"
+                << "  -g, --geometry FILE    benchmark an existing .g file\n"
+                << "  -o, --objects LIST     objects to load (default: all)\n"
+                << "  --regions N            synthetic regions (default: 1000)\n"
+                << "  --depth N              boolean ops per region (default: 3)\n"
+                << "  --rays N               rays per run (default: 1048576)\n"
+                << "  --threads N            max thread count (default: all)\n"
+                << "  --regionPrimitives     one Embree primitive per region\n"
+                << "  --hybrid               trace a tessellated proxy first\n"
+                << "  --keep                 keep the synthetic .g file\n"
+                << "  --output FILE          write JSON to FILE (default: stdout)\n";
+    }
+
+    static inline void parseCommandLine(int ac, const char **&av)
+    {
+      for (int i = 1; i < ac; i++) {
+        const std::string arg = av[i];
+        if (arg == "-g" || arg == "--geometry") {
+          filename = av[++i];
+        } else if (arg == "-o" || arg == "--objects") {
+          objects = av[++i];
+        } else if (arg == "--regions") {
+          numRegions = std::atoi(av[++i]);
+        } else if (arg == "--depth") {
+          booleanDepth = std::atoi(av[++i]);
+        } else if (arg == "--rays") {
+          numRays = std::atoi(av[++i]);
+        } else if (arg == "--threads") {
+          maxThreads = std::max(1, std::atoi(av[++i]));
+        } else if (arg == "--regionPrimitives") {
+          regionPrimitives = true;
+        } else if (arg == "--hybrid") {
+          hybrid = true;
+        } else if (arg == "--keep") {
+          keepDatabase = true;
+        } else if (arg == "--output") {
+          outputFile = av[++i];
+        } else {
+          printUsage();
+          std::exit(arg == "-h" || arg == "--help" ? 0 : 1);
+        }
+      }
+    }
+
+    extern "C" int main(int ac, const char **av)
+    {
+      int init_error = ospInit(&ac, av);
+      if (init_error != OSP_NO_ERROR) {
+        std::cerr << "FATAL ERROR DURING INITIALIZATION!" << std::endl;
+        return init_error;
+      }
+
+      auto device = ospGetCurrentDevice();
+      if (device == nullptr) {
+        std::cerr << "FATAL ERROR DURING GETTING CURRENT DEVICE!" << std::endl;
+        return 1;
+      }
+
+      // stdout is reserved for the JSON report
+      ospDeviceSetStatusFunc(device, [](const char *msg) { std::cerr << msg; });
+      ospDeviceSetErrorFunc(device,
+                            [](OSPError e, const char *msg) {
+                              std::cerr << "OSPRAY ERROR [" << e << "]: "
+                                        << msg << std::endl;
+                              std::exit(1);
+                            });
+
+      ospDeviceCommit(device);
+
+      parseCommandLine(ac, av);
+
+      ospLoadModule("brlcad");
+
+      // Database //
+
+      const bool synthetic = filename.empty();
+      double generateSeconds = 0.0;
+
+      if (synthetic) {
+        filename = "ospBrlcadBench-" + std::to_string(numRegions) + "x"
+                   + std::to_string(booleanDepth) + ".g";
+        objects  = "all";
+
+        const auto start = std::chrono::steady_clock::now();
+        generateDatabase(filename, numRegions, booleanDepth);
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        generateSeconds = elapsed.count();
+      }
+
+      // Geometry //
+
+      auto geometry = ospNewGeometry("brlcad");
+      ospSetString(geometry, "filename", filename.c_str());
+      ospSetString(geometry, "objects", objects.c_str());
+      ospSet1i(geometry, "regionPrimitives", regionPrimitives);
+      ospSet1i(geometry, "hybrid", hybrid);
+
+      const auto commitStart = std::chrono::steady_clock::now();
+      ospCommit(geometry);
+      const std::chrono::duration<double> commitTime =
+          std::chrono::steady_clock::now() - commitStart;
+
+      // where the commit went: librt's tree walk and prep, per scene
+      ospray_brlcad_load_stats loadStats = {};
+      auto getLoadStats = (ospray_brlcad_get_load_stats_t)
+          getSymbol("ospray_brlcad_get_load_stats");
+      if (getLoadStats == nullptr || getLoadStats(geometry, &loadStats) != 0)
+        std::cerr << "#ospBrlcadBench: no load statistics\n";
+
+      // NOTE: with the local device, object handles are the objects
+      //       themselves; the geometry is finalized into a scene of our own
+      //       so every packet width can be traced, not just what the
+      //       renderers happen to use
+      auto &geom = *(ospray::Geometry*)geometry;
+
+      ospray::Model model;
+      auto embreeDevice = (RTCDevice)ospray_getEmbreeDevice();
+      model.embreeSceneHandle =
+          rtcDeviceNewScene(embreeDevice,
+                            RTC_SCENE_STATIC,
+                            RTC_INTERSECT1 | RTC_INTERSECT4 |
+                            RTC_INTERSECT8 | RTC_INTERSECT16);
+
+      geom.finalize(&model);
+      rtcCommit(model.embreeSceneHandle);
+
+      const auto rays = generateRays(geom.bounds, numRays);
+
+      // Runs //
+
+      std::vector<int> widths = {1};
+      if (rtcDeviceGetParameter1i(embreeDevice, RTC_CONFIG_INTERSECT4))
+        widths.push_back(4);
+      if (rtcDeviceGetParameter1i(embreeDevice, RTC_CONFIG_INTERSECT8))
+        widths.push_back(8);
+      if (rtcDeviceGetParameter1i(embreeDevice, RTC_CONFIG_INTERSECT16))
+        widths.push_back(16);
+
+      std::vector<int> threadCounts;
+      for (int t = 1; t < maxThreads; t *= 2)
+        threadCounts.push_back(t);
+      threadCounts.push_back(maxThreads);
+
+      std::vector<RunResult> results;
+
+      for (int occlusion = 0; occlusion < 2; ++occlusion) {
+        for (int width : widths) {
+          for (int threads : threadCounts) {
+            results.push_back(run(model.embreeSceneHandle, rays,
+                                  width, threads, occlusion));
+            const auto &r = results.back();
+            std::cerr << "#ospBrlcadBench: " << r.query << " x" << r.width
+                      << " @ " << r.threads << " thread(s): "
+                      << (rays.size() / r.seconds) << " rays/s\n";
+          }
+        }
+      }
+
+      // Report //
+
+      std::stringstream json;
+      json << "{\n"
+           << "  \"database\": {\n"
+           << "    \"filename\": \"" << filename << "\",\n"
+           << "    \"objects\": \"" << objects << "\",\n"
+           << "    \"synthetic\": " << (synthetic ? "true" : "false");
+      if (synthetic) {
+        json << ",\n"
+             << "    \"regions\": " << numRegions << ",\n"
+             << "    \"booleanDepth\": " << booleanDepth << ",\n"
+             << "    \"generateSeconds\": " << generateSeconds;
+      }
+      json << "\n  },\n"
+           << "  \"regionPrimitives\": " << (regionPrimitives ? "true" : "false")
+           << ",\n"
+           << "  \"hybrid\": " << (hybrid ? "true" : "false") << ",\n"
+           << "  \"commitSeconds\": " << commitTime.count() << ",\n"
+           << "  \"treeSeconds\": " << loadStats.treeSeconds << ",\n"
+           << "  \"prepSeconds\": " << loadStats.prepSeconds << ",\n"
+           << "  \"resourceSeconds\": " << loadStats.resourceSeconds << ",\n"
+           << "  \"scenes\": " << loadStats.scenes << ",\n"
+           << "  \"prepCacheHits\": " << loadStats.prepCacheHits << ",\n"
+           << "  \"rays\": " << rays.size() << ",\n"
+           << "  \"runs\": [\n";
+
+      for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        json << "    {\"query\": \"" << r.query << "\", "
+             << "\"width\": " << r.width << ", "
+             << "\"threads\": " << r.threads << ", "
+             << "\"seconds\": " << r.seconds << ", "
+             << "\"raysPerSecond\": " << (rays.size() / r.seconds) << ", "
+             << "\"hitRatio\": " << (double(r.hits) / rays.size()) << "}"
+             << (i + 1 < results.size() ? ",\n" : "\n");
+      }
+
+      json << "  ],\n"
+           << "  \"peakRSSBytes\": " << peakRSS() << "\n"
+           << "}\n";
+
+      if (outputFile.empty())
+        std::cout << json.str();
+      else
+        std::ofstream(outputFile) << json.str();
+
+      rtcDeleteScene(model.embreeSceneHandle);
+      model.embreeSceneHandle = nullptr;
+
+      ospRelease(geometry);
+
+      if (synthetic && !keepDatabase)
+        std::remove(filename.c_str());
+
+      return 0;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -21,14 +21,17 @@
 
 #include "exampleViewer/widgets/imguiViewer.h"
 
-#include "ospcommon/tasking/tasking_system_handle.h"
-#include "ospcommon/utility/StringManip.h"
+#include "ospcommon/library.h"
 
-#undef UNUSED
-#undef _USE_MATH_DEFINES
-#include "brlcad/common.h"
-#include "brlcad/vmath.h"		/* vector math macros */
-#include "brlcad/raytrace.h"	/* librt interface definitions */
+#include "moduleAPI.h"
+
+#ifdef OSPRAY_BRLCAD_MPI
+#include "mpiCommon/MPICommon.h"
+#endif
+
+#include <chrono>
+#include <memory>
+#include <mutex>
 
 namespace ospray {
   namespace brlcad {
@@ -36,6 +39,13 @@ namespace ospray {
     std::string filename;
     std::string objects;
     std::string rendererType = "raycast";
+    bool showStats = false;
+    bool asyncLoad = false;
+    float motionBudget = 0.f;
+    float memoryCap = 0.f;
+    bool hitCache = false;
+    int numaNodes = 0;
+    bool distributed = false;
 
     struct BrlcadSGNode : public sg::Geometry
     {
@@ -54,26 +64,277 @@ namespace ospray {
 
     using namespace ospcommon;
 
-    rt_i *loadBrlcadGeometry(std::string filename, std::string objects)
+#ifdef OSPRAY_BRLCAD_MPI
+    /*! What rank 0 passes to the other ranks before each frame */
+    struct FrameState
+    {
+      vec3f pos, dir, up;
+      float aspect {1.f};
+      vec2i size {0};
+      int quit {0};
+    };
+
+    /*! The sg renderer of a distributed run. Frames are rendered by all
+        ranks together, so before each one rank 0 broadcasts the view its
+        window shows (as last published by its UI thread), and the other
+        ranks, which run headless, render that same view. */
+    struct DistributedRenderer : public sg::Renderer
+    {
+      DistributedRenderer()
+      {
+        // a communicator of its own, apart from the device's messages
+        MPI_Comm_dup(mpicommon::world.comm, &comm);
+      }
+
+      using sg::Renderer::traverse;
+
+      void traverse(sg::RenderContext &ctx,
+                    const std::string &operation) override
+      {
+        if (operation != "render") {
+          sg::Renderer::traverse(ctx, operation);
+          return;
+        }
+
+        FrameState state;
+        if (mpicommon::world.rank == 0) {
+          std::lock_guard<std::mutex> lock(publishedMutex);
+          state = published;
+        }
+
+        MPI_Bcast(&state, sizeof(state), MPI_BYTE, 0, comm);
+
+        if (state.quit) {
+          finished = true;
+          return;
+        }
+
+        if (mpicommon::world.rank != 0) {
+          follow(state);
+          traverse("verify");
+          traverse("commit");
+        }
+
+        sg::Renderer::traverse(ctx, operation);
+      }
+
+      /*! Rank 0: the view to broadcast before the next frame */
+      void publish(const FrameState &state)
+      {
+        std::lock_guard<std::mutex> lock(publishedMutex);
+        published = state;
+      }
+
+      /*! Rank 0, once it renders no more frames: let the others return
+          from renderUntilFinished() */
+      void finish()
+      {
+        FrameState state;
+        state.quit = 1;
+        MPI_Bcast(&state, sizeof(state), MPI_BYTE, 0, comm);
+      }
+
+      /*! The other ranks: render rank 0's views until it finishes */
+      void renderUntilFinished()
+      {
+        while (!finished)
+          traverse("render");
+      }
+
+    private:
+
+      /*! Set only what changed, so unchanged nodes are not re-committed */
+      void follow(const FrameState &state)
+      {
+        auto &camera = child("camera");
+        if (camera["pos"].valueAs<vec3f>() != state.pos)
+          camera["pos"] = state.pos;
+        if (camera["dir"].valueAs<vec3f>() != state.dir)
+          camera["dir"] = state.dir;
+        if (camera["up"].valueAs<vec3f>() != state.up)
+          camera["up"] = state.up;
+        if (camera.hasChild("aspect") &&
+            camera["aspect"].valueAs<float>() != state.aspect) {
+          camera["aspect"] = state.aspect;
+        }
+
+        auto &size = child("frameBuffer")["size"];
+        if (size.valueAs<vec2i>() != state.size)
+          size = state.size;
+      }
+
+      MPI_Comm comm;
+
+      std::mutex publishedMutex;
+      FrameState published;
+
+      bool finished {false};
+    };
+
+    /*! The view of 'renderer' (read on the UI thread) */
+    FrameState currentFrameState(sg::Node &renderer)
+    {
+      auto &camera = renderer["camera"];
+
+      FrameState state;
+      state.pos  = camera["pos"].valueAs<vec3f>();
+      state.dir  = camera["dir"].valueAs<vec3f>();
+      state.up   = camera["up"].valueAs<vec3f>();
+      state.size = renderer["frameBuffer"]["size"].valueAs<vec2i>();
+      if (camera.hasChild("aspect"))
+        state.aspect = camera["aspect"].valueAs<float>();
+      return state;
+    }
+#endif
+
+    /*! The sg viewer, plus what the 'brlcad' module needs done between
+        frames. display() runs on the UI thread, the same one that edits the
+        scene graph, so nothing here outlives the window or races the UI. */
+    struct BrlcadViewer : public ImGuiViewer
+    {
+      BrlcadViewer(const std::shared_ptr<sg::Node> &renderer,
+                   sg::Node &geometry)
+        : ImGuiViewer(renderer),
+          camera((*renderer)["camera"]),
+          geometry(geometry)
+      {
+        if (geometry.hasChild("async")) {
+          pendingLoads = (ospray_brlcad_pending_loads_t)
+              getSymbol("ospray_brlcad_pending_loads");
+        }
+
+        if (geometry.hasChild("stats")) {
+          postStats = (ospray_brlcad_post_stats_t)
+              getSymbol("ospray_brlcad_post_stats");
+        }
+
+        if (geometry.hasChild("memoryCap")) {
+          accountMemory = (ospray_brlcad_account_memory_t)
+              getSymbol("ospray_brlcad_account_memory");
+        }
+
+        watchEye = geometry.hasChild("hitCacheEye");
+
+        if (geometry.hasChild("motionBudget")) {
+          noteMotion = (ospray_brlcad_note_motion_t)
+              getSymbol("ospray_brlcad_note_motion");
+          motionSettled = (ospray_brlcad_motion_settled_t)
+              getSymbol("ospray_brlcad_motion_settled");
+        }
+
+#ifdef OSPRAY_BRLCAD_MPI
+        distributed = std::dynamic_pointer_cast<DistributedRenderer>(renderer);
+#endif
+      }
+
+    protected:
+
+      void display() override
+      {
+        // once the background load is done, commit again without 'async'
+        // for the region table, region primitives and exact bounds
+        if (pendingLoads && pendingLoads() == 0) {
+          geometry["async"] = 0;
+          pendingLoads = nullptr;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        // report camera changes to the module, which traces sparsely
+        // meanwhile
+        const auto pos = camera["pos"].valueAs<vec3f>();
+        const auto dir = camera["dir"].valueAs<vec3f>();
+        const auto up  = camera["up"].valueAs<vec3f>();
+        if (pos != lastPos || dir != lastDir || up != lastUp) {
+          if (noteMotion)
+            noteMotion();
+          lastChange = now;
+        }
+        lastPos = pos;
+        lastDir = dir;
+        lastUp  = up;
+
+        // the hit cache only serves rays from its eye, and moving that
+        // re-commits the geometry, so it follows the camera once at rest
+        if (watchEye && now - lastChange >= std::chrono::milliseconds(200) &&
+            geometry["hitCacheEye"].valueAs<vec3f>() != pos) {
+          geometry["hitCacheEye"] = pos;
+        }
+
+        // the frames accumulated while moving were traced sparsely, so
+        // restart accumulation once the module traces in full again
+        if (motionSettled && motionSettled())
+          camera.markAsModified();
+
+        // frames are rendered asynchronously, so statistics are posted and
+        // the memory cap checked once per second instead of per frame
+        if (now - lastPoll >= std::chrono::seconds(1)) {
+          lastPoll = now;
+          if (postStats)
+            postStats(1);
+          if (accountMemory)
+            accountMemory(0);
+        }
+
+#ifdef OSPRAY_BRLCAD_MPI
+        // the other ranks render whatever this window shows
+        if (distributed)
+          distributed->publish(currentFrameState(*distributed));
+#endif
+
+        ImGuiViewer::display();
+      }
+
+    private:
+
+      sg::Node &camera;
+      sg::Node &geometry;
+
+      ospray_brlcad_pending_loads_t  pendingLoads {nullptr};
+      ospray_brlcad_post_stats_t     postStats {nullptr};
+      ospray_brlcad_account_memory_t accountMemory {nullptr};
+      ospray_brlcad_note_motion_t    noteMotion {nullptr};
+      ospray_brlcad_motion_settled_t motionSettled {nullptr};
+
+      bool watchEye {false};
+
+#ifdef OSPRAY_BRLCAD_MPI
+      std::shared_ptr<DistributedRenderer> distributed;
+#endif
+
+      vec3f lastPos, lastDir, lastUp;
+      std::chrono::steady_clock::time_point lastChange;
+      std::chrono::steady_clock::time_point lastPoll {
+          std::chrono::steady_clock::now()};
+    };
+
+    /*! Bounds of the objects to load, asked from the 'brlcad' module so the
+        database is opened once and shared with the geometry, and nothing is
+        prepped just to place the camera */
+    box3f loadBrlcadBounds(std::string filename, std::string objects)
     {
       if (filename.empty()) {
         throw std::runtime_error("No input filename provided!"
                                  " Use '-g [filename]' to specify the file.");
       }
 
-      auto *rtip = rt_dirbuild(filename.c_str(), nullptr, 0);
-      auto objNames = utility::split(objects, ',');
-
-      if (objNames.empty()) {
+      if (objects.empty()) {
         throw std::runtime_error("No objects provided! Use '-o [objects]' with"
                                  " a comma separated list of object names.");
       }
 
-      for (const auto &obj : objNames)
-        rt_gettree(rtip, obj.c_str());
+      auto queryBounds = (ospray_brlcad_query_bounds_t)
+          getSymbol("ospray_brlcad_query_bounds");
+
+      if (queryBounds == nullptr)
+        throw std::runtime_error("The 'brlcad' module is not loaded!");
+
+      float b[6];
+      if (queryBounds(filename.c_str(), objects.c_str(), b) != 0)
+        throw std::runtime_error("Could not read the bounds of '" + objects
+                                 + "' in " + filename);
 
-      rt_prep_parallel(rtip, tasking::numTaskingThreads());
-      return rtip;
+      return box3f(vec3f(b[0], b[1], b[2]), vec3f(b[3], b[4], b[5]));
     }
 
     static inline void parseCommandLine(int ac, const char **&av)
@@ -86,6 +347,20 @@ namespace ospray {
           objects = av[++i];
         } else if (arg == "-r" || arg == "--renderer") {
           rendererType = av[++i];
+        } else if (arg == "--stats") {
+          showStats = true;
+        } else if (arg == "--async") {
+          asyncLoad = true;
+        } else if (arg == "--motion-budget") {
+          motionBudget = std::stof(av[++i]);
+        } else if (arg == "--memory-cap") {
+          memoryCap = std::stof(av[++i]);
+        } else if (arg == "--hit-cache") {
+          hitCache = true;
+        } else if (arg == "--numa-nodes") {
+          numaNodes = std::stoi(av[++i]);
+        } else if (arg == "--distributed") {
+          distributed = true;
         }
       }
     }
@@ -98,6 +373,33 @@ namespace ospray {
         return init_error;
       }
 
+      parseCommandLine(ac, av);
+
+      // Data-parallel mode: every rank (under mpirun) loads its share of the
+      // objects, and the distributed device composites the ranks' images;
+      // only rank 0 opens a window, the others follow its view
+      int rank = 0, numRanks = 1;
+
+#ifdef OSPRAY_BRLCAD_MPI
+      if (distributed) {
+        ospLoadModule("mpi");
+        auto mpiDevice = ospNewDevice("mpi_distributed");
+        ospDeviceSet1i(mpiDevice, "masterRank", 0);
+        ospDeviceCommit(mpiDevice);
+        ospSetCurrentDevice(mpiDevice);
+
+        rank         = mpicommon::world.rank;
+        numRanks     = mpicommon::world.size;
+        rendererType = "mpi_raycast";
+      }
+#else
+      if (distributed) {
+        std::cerr << "--distributed needs the viewer built with OSPRay's MPI"
+                  << " module (OSPRAY_MODULE_MPI)" << std::endl;
+        return 1;
+      }
+#endif
+
       auto device = ospGetCurrentDevice();
       if (device == nullptr) {
         std::cerr << "FATAL ERROR DURING GETTING CURRENT DEVICE!" << std::endl;
@@ -120,7 +422,18 @@ namespace ospray {
 
       box3f worldBounds;
 
-      auto renderer_ptr = sg::createNode("renderer", "Renderer");
+      std::shared_ptr<sg::Node> renderer_ptr;
+#ifdef OSPRAY_BRLCAD_MPI
+      std::shared_ptr<DistributedRenderer> distributedRenderer;
+      if (numRanks > 1) {
+        distributedRenderer = std::make_shared<DistributedRenderer>();
+        distributedRenderer->setName("renderer");
+        distributedRenderer->setType("Renderer");
+        renderer_ptr = distributedRenderer;
+      }
+#endif
+      if (!renderer_ptr)
+        renderer_ptr = sg::createNode("renderer", "Renderer");
       auto &renderer = *renderer_ptr;
 
       renderer["frameBuffer"]["size"] = vec2i(1024, 768);
@@ -129,28 +442,64 @@ namespace ospray {
 
       // Load BRLCAD geometry and create BRLCAD geometry scenegraph node
 
-      auto &brlcadInstance = world.createChild("brlcad_instance", "Instance");
+      // (a distributed model takes the geometry itself, with its region)
+      auto &brlcadModel = numRanks > 1 ? world
+          : world.createChild("brlcad_instance", "Instance")["model"];
 
       auto brlcadGeometryNode = std::make_shared<BrlcadSGNode>();
       brlcadGeometryNode->setName("loaded_example_brlcad");
       brlcadGeometryNode->setType("BrlcadSGNode");
 
-      parseCommandLine(ac, av);
-      auto *brlcadGeom = loadBrlcadGeometry(filename, objects);
-
-      brlcadGeometryNode->brlcadBounds.lower.x = brlcadGeom->mdl_min[0];
-      brlcadGeometryNode->brlcadBounds.lower.y = brlcadGeom->mdl_min[1];
-      brlcadGeometryNode->brlcadBounds.lower.z = brlcadGeom->mdl_min[2];
-      brlcadGeometryNode->brlcadBounds.upper.x = brlcadGeom->mdl_max[0];
-      brlcadGeometryNode->brlcadBounds.upper.y = brlcadGeom->mdl_max[1];
-      brlcadGeometryNode->brlcadBounds.upper.z = brlcadGeom->mdl_max[2];
-
-      rt_free_rti(brlcadGeom);
+      brlcadGeometryNode->brlcadBounds = loadBrlcadBounds(filename, objects);
 
       brlcadGeometryNode->createChild("filename", "string", filename);
       brlcadGeometryNode->createChild("objects", "string", objects);
 
-      brlcadInstance["model"].add(brlcadGeometryNode);
+      // the window opens on the objects' bounding boxes while they are
+      // prepped in the background
+      if (asyncLoad)
+        brlcadGeometryNode->createChild("async", "int", 1);
+
+      if (showStats)
+        brlcadGeometryNode->createChild("stats", "int", 1);
+
+      if (motionBudget > 0.f)
+        brlcadGeometryNode->createChild("motionBudget", "float", motionBudget);
+
+      // the viewer checks the cap between frames, trimming librt's free
+      // lists if the geometry has grown past it
+      if (memoryCap > 0.f)
+        brlcadGeometryNode->createChild("memoryCap", "float", memoryCap);
+
+      if (numaNodes > 1)
+        brlcadGeometryNode->createChild("numaNodes", "int", numaNodes);
+
+      // the camera still frames all objects, but this rank only loads (and
+      // reports as its region) its own share
+      box3f rankRegion = brlcadGeometryNode->brlcadBounds;
+      if (numRanks > 1) {
+        brlcadGeometryNode->createChild("rank", "int", rank);
+        brlcadGeometryNode->createChild("numRanks", "int", numRanks);
+
+        auto queryRankBounds = (ospray_brlcad_query_rank_bounds_t)
+            getSymbol("ospray_brlcad_query_rank_bounds");
+        float b[6];
+        if (queryRankBounds &&
+            queryRankBounds(filename.c_str(), objects.c_str(),
+                            rank, numRanks, b) == 0) {
+          rankRegion = box3f(vec3f(b[0], b[1], b[2]), vec3f(b[3], b[4], b[5]));
+        }
+      }
+
+      // one cached hit per pixel: the camera's default 60 degree field of
+      // view over the frame buffer's height
+      if (hitCache) {
+        const float fovy = 60.f * float(M_PI) / 180.f;
+        const float height = renderer["frameBuffer"]["size"].valueAs<vec2i>().y;
+        brlcadGeometryNode->createChild("hitCache", "float", fovy / height);
+      }
+
+      brlcadModel.add(brlcadGeometryNode);
 
       renderer["rendererType"] = rendererType;
 
@@ -170,19 +519,55 @@ namespace ospray {
       camera["up"] = up;
       camera.createChild("gaze", "vec3f", gaze);
 
+      // the hit cache starts out serving the initial camera
+      if (hitCache)
+        brlcadGeometryNode->createChild("hitCacheEye", "vec3f", pos);
+
+      // The distributed model composites ranks by their regions' depth
+      if (numRanks > 1) {
+        renderer.traverse("verify");
+        renderer.traverse("commit");
+
+        auto model = brlcadModel.valueAs<OSPModel>();
+        auto regions = ospNewData(2, OSP_FLOAT3, &rankRegion);
+        ospSetData(model, "regions", regions);
+        ospSet1i(model, "id", rank);
+        ospCommit(model);
+      }
+
+#ifdef OSPRAY_BRLCAD_MPI
+      if (distributedRenderer) {
+        distributedRenderer->publish(currentFrameState(renderer));
+
+        if (rank != 0) {
+          distributedRenderer->renderUntilFinished();
+          return 0;
+        }
+      }
+#endif
+
       // Create window and launch app
+      {
+        BrlcadViewer window(renderer_ptr, *brlcadGeometryNode);
 
-      ospray::ImGuiViewer window(renderer_ptr);
+        auto &viewPort = window.viewPort;
 
-      auto &viewPort = window.viewPort;
-      auto dir = normalize(viewPort.at - viewPort.from);
+        if (renderer["camera"].hasChild("focusdistance")) {
+          renderer["camera"]["focusdistance"] =
+              length(viewPort.at - viewPort.from);
+        }
+
+        window.create("OSPRay BRLCAD Viewer App");
 
-      if (renderer["camera"].hasChild("focusdistance"))
-        renderer["camera"]["focusdistance"] = length(viewPort.at-viewPort.from);
+        ospray::imgui3D::run();
+      }
 
-      window.create("OSPRay BRLCAD Viewer App");
+#ifdef OSPRAY_BRLCAD_MPI
+      // the window (and its render thread) is gone, release the other ranks
+      if (distributedRenderer)
+        distributedRenderer->finish();
+#endif
 
-      ospray::imgui3D::run();
       return 0;
     }
 
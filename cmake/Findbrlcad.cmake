@@ -31,6 +31,7 @@ find_library(BRLCAD_BU_LIBRARY bu PATHS ${BRLCAD_ROOT}/lib NO_DEFAULT_PATH)
 find_library(BRLCAD_BN_LIBRARY bn PATHS ${BRLCAD_ROOT}/lib NO_DEFAULT_PATH)
 find_library(BRLCAD_ON_LIBRARY openNURBS PATHS ${BRLCAD_ROOT}/lib NO_DEFAULT_PATH)
 find_library(BRLCAD_RT_LIBRARY rt PATHS ${BRLCAD_ROOT}/lib NO_DEFAULT_PATH)
+find_library(BRLCAD_WDB_LIBRARY wdb PATHS ${BRLCAD_ROOT}/lib NO_DEFAULT_PATH)
 
 set(BRLCAD_ERROR_MESSAGE 
 "Could not find BRLCAD! Please set BRLCAD_ROOT to to point to your BRLCAD installation")
@@ -53,6 +54,11 @@ if (BRLCAD_FOUND)
     ${BRLCAD_ON_LIBRARY}
     ${BRLCAD_RT_LIBRARY}
   )
+  # only needed by applications that write .g files
+  set(BRLCAD_WDB_LIBRARIES
+    ${BRLCAD_WDB_LIBRARY}
+    ${BRLCAD_LIBRARIES}
+  )
 endif()
 
 mark_as_advanced(BRLCAD_INCLUDE_DIR)
@@ -60,3 +66,4 @@ mark_as_advanced(BRLCAD_BU_LIBRARY)
 mark_as_advanced(BRLCAD_BN_LIBRARY)
 mark_as_advanced(BRLCAD_ON_LIBRARY)
 mark_as_advanced(BRLCAD_RT_LIBRARY)
+mark_as_advanced(BRLCAD_WDB_LIBRARY)
@@ -20,74 +20,105 @@
 #include "ospray/common/Data.h"
 #include "ospray/common/Model.h"
 #include "ospray/common/Ray.h"
+#include "ospray/api/ISPCDevice.h"
+#include "ospray/render/Material.h"
 
-#include "ospcommon/tasking/tasking_system_handle.h"
 #include "ospcommon/utility/StringManip.h"
 
+#include "librt/DeferredHit.h"
+#include "librt/Instancing.h"
+#include "librt/Numa.h"
+#include "librt/Partition.h"
+#include "librt/Registry.h"
+#include "librt/Stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
 #include <mutex>
-#include <thread>
-#include <unordered_map>
+#include <set>
 
 namespace ospray {
   namespace brlcad {
 
-    static inline int getCpuId()
-    {
-      static std::unordered_map<std::thread::id, int> threadIds;
-      static int nextId{1};
-      static std::mutex idMutex;
-
-      const auto currentThread = std::this_thread::get_id();
+    // Local helper functions /////////////////////////////////////////////////
 
-      auto id = threadIds[currentThread];
+    /*! The interval of a ray that is left to trace after clipping (see
+        clipRay()) */
+    struct ClipRange
+    {
+      float tnear;
+      float tfar;
 
-      if (id == 0) {
-        SCOPED_LOCK(idMutex);
-        threadIds[currentThread] = id = nextId++;
-      }
+      /*! 'tfar' was moved in by a clip plane or the section box */
+      bool  clipped {false};
 
-      return id - 1;
-    }
+      /*! 'tnear' was moved up to a cut; material straddling it is hit there,
+          on a cap facing 'capNormal' */
+      bool  capped {false};
+      vec3f capNormal;
 
-    // Local helper functions /////////////////////////////////////////////////
+      ClipRange(float tnear, float tfar) : tnear(tnear), tfar(tfar) {}
+    };
 
-    template<typename T>
-    inline static void extractRay(const T& rays, RTCRay &ray, int i)
+    /*! Closest hit found by hitCallback() for the ray currently in flight.
+        Its normal is only evaluated in postIntersect, and only if this hit
+        survives as the closest one along the Embree ray. */
+    struct HitRecord
     {
-      ray.org[0] = rays.orgx[i];
-      ray.org[1] = rays.orgy[i];
-      ray.org[2] = rays.orgz[i];
-
-      ray.dir[0] = rays.dirx[i];
-      ray.dir[1] = rays.diry[i];
-      ray.dir[2] = rays.dirz[i];
+      float       t;
+      uint        primID;
+      DeferredHit surface;
+
+      /*! The clipped interval being traced, if the geometry clips */
+      const ClipRange *clip {nullptr};
+    };
+
+    /*! A recently shot ray and its result. With one Embree primitive per
+        region, a ray overlapping several region boxes is handed to us once
+        per primitive, but librt always answers with the closest hit over the
+        whole scene, so the first rt_shootray() settles all the others. */
+    struct ShotMemo
+    {
+      uint64_t  version {0};
+      vec3f     org;
+      vec3f     dir;
+      float     tnear;
+      float     tfar;
+      bool      hit;
+      HitRecord record;
+    };
 
-      ray.tnear  = rays.tnear[i];
-      ray.tfar   = rays.tfar[i];
+    static constexpr int SHOT_MEMO_SIZE = 64;
 
-      ray.time   = rays.time[i];
-      ray.mask   = rays.mask[i];
+    static thread_local ShotMemo shotMemo[SHOT_MEMO_SIZE];
 
-      ray.primID = rays.primID[i];
-      ray.geomID = rays.geomID[i];
-      ray.instID = rays.instID[i];
+    inline static uint32_t floatBits(float f)
+    {
+      uint32_t u;
+      std::memcpy(&u, &f, sizeof(u));
+      return u;
     }
 
-    template<typename T>
-    inline static void insertRay(const RTCRay& ray, T &rays, int i)
+    inline static float bitsToFloat(uint32_t u)
     {
-      if (ray.geomID != RTC_INVALID_GEOMETRY_ID) {
-        rays.Ngx[i] = ray.Ng[0];
-        rays.Ngy[i] = ray.Ng[1];
-        rays.Ngz[i] = ray.Ng[2];
+      float f;
+      std::memcpy(&f, &u, sizeof(f));
+      return f;
+    }
 
-        rays.primID[i] = ray.primID;
-        rays.geomID[i] = ray.geomID;
-        rays.instID[i] = ray.instID;
-        rays.tfar[i]   = ray.tfar;
-        rays.u[i]      = ray.u;
-        rays.v[i]      = ray.v;
-      }
+    inline static ShotMemo &lookupShotMemo(const vec3f &org, const vec3f &dir)
+    {
+      const uint32_t h = floatBits(org.x) * 73856093u
+                       ^ floatBits(org.y) * 19349663u
+                       ^ floatBits(org.z) * 83492791u
+                       ^ floatBits(dir.x) * 2654435761u
+                       ^ floatBits(dir.y) * 40503u
+                       ^ floatBits(dir.z) * 2246822519u;
+      return shotMemo[(h ^ (h >> 16)) % SHOT_MEMO_SIZE];
     }
 
     static int hitCallback(application *ap,
@@ -97,13 +128,31 @@ namespace ospray {
       /* will contain surface curvature information at the entry */
       curvature cur = RT_CURVATURE_INIT_ZERO;
 
-      auto &ray = *static_cast<RTCRay*>(ap->a_uptr);
+      auto &hit = *static_cast<HitRecord*>(ap->a_uptr);
 
       /* iterate over each partition until we get back to the head.
        * each partition corresponds to a specific homogeneous region of
        * material.
        */
       for (auto *pp = PartHeadp->pt_forw; pp != PartHeadp; pp = pp->pt_forw) {
+        /* material cut away by a clip plane or the section box is skipped,
+         * and material the cut passes through is hit on the cap.
+         */
+        if (const auto *clip = hit.clip) {
+          if (clip->clipped && pp->pt_inhit->hit_dist > clip->tfar)
+            break;
+
+          if (clip->capped && pp->pt_inhit->hit_dist < clip->tnear) {
+            if (pp->pt_outhit->hit_dist < clip->tnear)
+              continue;
+
+            hit.surface.recordNormal(clip->capNormal);
+            hit.t = clip->tnear;
+            hit.primID = pp->pt_regionp->reg_bit;
+            return 1;
+          }
+        }
+
         /* entry hit point, so we type less */
         auto *hitp = pp->pt_inhit;
 
@@ -118,16 +167,13 @@ namespace ospray {
         /* primitive we encountered on entry */
         auto *stp = pp->pt_inseg->seg_stp;
 
-        /* compute the normal vector at the entry point, flipping the
-         * normal if necessary.
+        /* keep what is needed to compute the normal vector at the entry
+         * point later, should this hit survive.
          */
-        vect_t inormal;
-        RT_HIT_NORMAL(inormal, hitp, stp, &(ap->a_ray), pp->pt_inflip);
+        hit.surface.record(stp, hitp, ap->a_ray, pp->pt_inflip);
 
-        ray.tfar = hitp->hit_dist;
-        ray.Ng[0] = inormal[0];
-        ray.Ng[1] = inormal[1];
-        ray.Ng[2] = inormal[2];
+        hit.t = hitp->hit_dist;
+        hit.primID = pp->pt_regionp->reg_bit;
 #if 0
         /* This next macro fills in the curvature information which
          * consists on a principle direction vector, and the inverse
@@ -154,10 +200,17 @@ namespace ospray {
         vect_t onormal;
         RT_HIT_NORMAL(onormal, hitp, stp, &(ap->a_ray), pp->pt_outflip);
   #endif
+
+        /* partitions come sorted front to back; the first one is the
+         * closest hit, along with its region.
+         */
+
+        // Return '1' for hit
+        return 1;
       }
 
-      // Return '1' for hit
-      return 1;
+      // Everything along the ray was clipped away
+      return 0;
     }
 
     static int missCallback(application *ap)
@@ -166,132 +219,2130 @@ namespace ospray {
       return 0;
     }
 
-    static void traceRay(const BRLCAD &geom, RTCRay& ray)
+    static int occludedCallback(application *ap,
+                                partition *PartHeadp,
+                                seg *segs)
     {
-      application ap;
+      /* any material inside the ray interval blocks it; no normals or other
+       * surface data are needed for that.
+       */
+      for (auto *pp = PartHeadp->pt_forw; pp != PartHeadp; pp = pp->pt_forw) {
+        if (pp->pt_outhit->hit_dist >= ap->a_ray.r_min &&
+            pp->pt_inhit->hit_dist <= ap->a_ray.r_max) {
+          // Return '1' for occluded
+          return 1;
+        }
+      }
 
+      return 0;
+    }
+
+    /*! Set up the parts of an application that are the same for every ray
+        shot against 'scene' by the calling thread */
+    static void initApplication(const Scene &scene,
+                                application &ap,
+                                HitRecord &hit)
+    {
       RT_APPLICATION_INIT(&ap);
 
-      ap.a_rt_i = geom.rtip;
+      ap.a_rt_i = scene.rtip;
       ap.a_onehit = 1;
 
-      ap.a_resource = &geom.resources[getCpuId()];
-
-      VSET(ap.a_ray.r_pt, ray.org[0], ray.org[1], ray.org[2]);
-      VSET(ap.a_ray.r_dir, ray.dir[0], ray.dir[1], ray.dir[2]);
-      ap.a_ray.r_min = ray.tnear;
-      ap.a_ray.r_max = ray.tfar;
+      ap.a_resource = scene.resources.local();
 
       ap.a_hit  = hitCallback;
       ap.a_miss = missCallback;
-      ap.a_uptr = &ray;
+      ap.a_uptr = &hit;
+    }
+
+    /*! A scalar Embree ray for tracing one of our own Embree scenes */
+    inline static RTCRay makeRay(const vec3f &org,
+                                 const vec3f &dir,
+                                 float tnear,
+                                 float tfar)
+    {
+      RTCRay ray;
+      ray.org[0] = org.x;
+      ray.org[1] = org.y;
+      ray.org[2] = org.z;
+      ray.dir[0] = dir.x;
+      ray.dir[1] = dir.y;
+      ray.dir[2] = dir.z;
+      ray.tnear  = tnear;
+      ray.tfar   = tfar;
+      ray.time   = 0.f;
+      ray.mask   = -1;
+      ray.geomID = RTC_INVALID_GEOMETRY_ID;
+      ray.primID = RTC_INVALID_GEOMETRY_ID;
+      ray.instID = RTC_INVALID_GEOMETRY_ID;
+      return ray;
+    }
+
+    /*! Trace a ray against the tessellated proxy, returning whether (and
+        where) it hits inside [tnear, tfar] */
+    static bool intersectProxy(const Scene &scene,
+                               const vec3f &org,
+                               const vec3f &dir,
+                               float tnear,
+                               float tfar,
+                               float &t)
+    {
+      RTCRay ray = makeRay(org, dir, tnear, tfar);
+
+      rtcIntersect(scene.proxyScene, ray);
+
+      t = ray.tfar;
+      return ray.geomID != RTC_INVALID_GEOMETRY_ID;
+    }
+
+    /*! The Scene 'prim' traces (the copy on the calling thread's node, in
+        NUMA mode), or null while the background load that provides it is
+        still running */
+    inline static const Scene *primitiveScene(const BRLCAD &geom,
+                                              const BRLCAD::Primitive &prim)
+    {
+      if (prim.replicas)
+        return prim.replicas[currentNumaNode(geom.numaNodes)];
+
+      return prim.scene ? prim.scene : prim.pending->scene(prim.object);
+    }
+
+    /*! Offset of the reg_bits of primitiveScene(geom, prim) in the primIDs
+        'geom' reports: fixed at commit, or (while loading in the background)
+        once the object became ready */
+    inline static uint primitiveBase(const BRLCAD::Primitive &prim)
+    {
+      return prim.pending ? prim.pending->primBase(prim.object)
+                          : prim.primBase;
+    }
+
+    /*! Slab test against the bounding box traced in place of a Scene that is
+        still loading, returning whether (and where) the ray enters it inside
+        [tnear, tfar]; an object whose load failed is never hit */
+    static bool intersectPlaceholder(const BRLCAD::Primitive &prim,
+                                     const vec3f &org,
+                                     const vec3f &dir,
+                                     float tnear,
+                                     float tfar,
+                                     float &t)
+    {
+      if (prim.pending->failed(prim.object))
+        return false;
+
+      const box3f &box = prim.bounds;
+
+      float t0 = tnear;
+      float t1 = tfar;
+
+      for (int a = 0; a < 3; ++a) {
+        const float rcp = 1.f / dir[a];
+        float tn = (box.lower[a] - org[a]) * rcp;
+        float tf = (box.upper[a] - org[a]) * rcp;
+        if (tn > tf)
+          std::swap(tn, tf);
+        t0 = std::max(t0, tn);
+        t1 = std::min(t1, tf);
+      }
+
+      t = t0;
+      return t0 <= t1;
+    }
+
+    /*! Narrow 'range' down to what 'geom's clip planes and section box
+        leave of the ray, returning false if nothing is left (so the ray need
+        not be shot at all) */
+    static bool clipRay(const BRLCAD &geom,
+                        const vec3f &org,
+                        const vec3f &dir,
+                        ClipRange &range)
+    {
+      if (!geom.clipping)
+        return true;
+
+      float t0 = range.tnear;
+      float t1 = range.tfar;
+      vec3f capNormal(0.f);
+
+      for (const auto &plane : geom.clipPlanes) {
+        const vec3f n(plane.x, plane.y, plane.z);
+        const float dist  = dot(n, org) + plane.w;
+        const float slope = dot(n, dir);
+
+        if (slope == 0.f) {
+          if (dist > 0.f)
+            return false;
+          continue;
+        }
+
+        const float t = -dist / slope;
+        if (slope > 0.f) {
+          t1 = std::min(t1, t);
+        } else if (t > t0) {
+          t0 = t;
+          capNormal = n;
+        }
+      }
+
+      const auto &box = geom.sectionBox;
+      if (!box.empty()) {
+        for (int a = 0; a < 3; ++a) {
+          if (dir[a] == 0.f) {
+            if (org[a] < box.lower[a] || org[a] > box.upper[a])
+              return false;
+            continue;
+          }
+
+          const float rcp = 1.f / dir[a];
+          float tn = (box.lower[a] - org[a]) * rcp;
+          float tf = (box.upper[a] - org[a]) * rcp;
+          if (tn > tf)
+            std::swap(tn, tf);
+
+          if (tn > t0) {
+            t0 = tn;
+            capNormal = vec3f(0.f);
+            capNormal[a] = dir[a] > 0.f ? -1.f : 1.f;
+          }
+          t1 = std::min(t1, tf);
+        }
+      }
+
+      if (t0 > t1)
+        return false;
+
+      range.capped    = t0 > range.tnear;
+      range.clipped   = t1 < range.tfar;
+      range.capNormal = range.capped ? normalize(capNormal) : vec3f(0.f);
+      range.tnear     = t0;
+      range.tfar      = t1;
+      return true;
+    }
+
+    // NOTE: placeholder hits carry no deferred hit record, so postIntersect
+    //       shades them with the ray direction as normal
+    static constexpr DeferredHitHandle PLACEHOLDER_HANDLE {-1, 0};
+
+    /*! rt_shootray(), timed into the thread's counters if 'geom' collects
+        statistics */
+    inline static int shoot(const BRLCAD &geom, application &ap)
+    {
+      return geom.collectStats ? timedShootray(&ap) : rt_shootray(&ap);
+    }
+
+    /*! Count one callback invocation of 'width' with 'rays' valid rays, of
+        which 'hits' hit (or were occluded) */
+    inline static void countCall(StatsQuery query,
+                                 int width,
+                                 int rays,
+                                 int hits)
+    {
+      auto &stats = localStats();
+      const int w = widthIndex(width);
+      stats.calls[query][w].add(1);
+      stats.rays[query][w].add(rays);
+      stats.hits[query].add(hits);
+      stats.misses[query].add(rays - hits);
+    }
+
+    inline static int countValid(const int *valid, int N)
+    {
+      int n = 0;
+      for (int i = 0; i < N; ++i)
+        n += valid[i] != 0;
+      return n;
+    }
+
+    /*! Widest packet Embree hands to the fixed width callbacks, and the
+        widest tracePacket() takes (see shootReordered() for wider ones) */
+    static constexpr int MAX_PACKET_SIZE = 16;
+
+    /*! Fill 'lanes' with the indices of the valid lanes of a packet of
+        'N', returning how many there are */
+    inline static int validLanes(const int *valid, size_t N, int *lanes)
+    {
+      int n = 0;
+      for (size_t i = 0; i < N; ++i) {
+        if (valid[i])
+          lanes[n++] = i;
+      }
+      return n;
+    }
+
+    /*! Spread the low 10 bits of 'x' out to every third bit */
+    inline static uint64_t spreadBits3(uint64_t x)
+    {
+      x &= 0x3ff;
+      x = (x | (x << 16)) & 0x30000ff;
+      x = (x | (x <<  8)) & 0x300f00f;
+      x = (x | (x <<  4)) & 0x30c30c3;
+      x = (x | (x <<  2)) & 0x9249249;
+      return x;
+    }
+
+    /*! Quantize 'v' in [lo, hi] to 'bits' bits */
+    inline static uint64_t quantize(float v, float lo, float hi, int bits)
+    {
+      const float range = hi - lo;
+      const float f = range > 0.f ? (v - lo) / range : 0.f;
+      const float max = float((1 << bits) - 1);
+      return uint64_t(std::min(max, std::max(0.f, f * max)));
+    }
+
+    /*! Sort key of a ray: direction octant first, then the Morton code of
+        its origin inside 'bounds', then the Morton code of its direction,
+        so rays next to each other start in the same part of librt's space
+        partition and head the same way through it */
+    inline static uint64_t rayOrderKey(const box3f &bounds,
+                                       const vec3f &org,
+                                       const vec3f &dir)
+    {
+      const uint64_t octant = (dir.x < 0.f ? 1 : 0)
+                            | (dir.y < 0.f ? 2 : 0)
+                            | (dir.z < 0.f ? 4 : 0);
+
+      const uint64_t orgCode =
+          spreadBits3(quantize(org.x, bounds.lower.x, bounds.upper.x, 10))
+          | spreadBits3(quantize(org.y, bounds.lower.y, bounds.upper.y, 10)) << 1
+          | spreadBits3(quantize(org.z, bounds.lower.z, bounds.upper.z, 10)) << 2;
+
+      const uint64_t dirCode =
+          spreadBits3(quantize(dir.x, -1.f, 1.f, 7))
+          | spreadBits3(quantize(dir.y, -1.f, 1.f, 7)) << 1
+          | spreadBits3(quantize(dir.z, -1.f, 1.f, 7)) << 2;
+
+      return octant << 51 | orgCode << 21 | dirCode;
+    }
+
+    /*! Shoot one ray through 'ap' (set up by initApplication()), filling
+        in 'hit' and returning whether anything was hit in 'range' (already
+        narrowed by clipRay()) */
+    static bool shootRay(const BRLCAD &geom,
+                         const Scene &scene,
+                         application &ap,
+                         HitRecord &hit,
+                         const vec3f &org,
+                         const vec3f &dir,
+                         const ClipRange &range)
+    {
+      const float tnear = range.tnear;
+      const float tfar  = range.tfar;
+
+      hit.clip = geom.clipping ? &range : nullptr;
+
+      ShotMemo *memo = nullptr;
+
+      if (geom.regionPrimitives) {
+        memo = &lookupShotMemo(org, dir);
+        if (memo->version == scene.version &&
+            memo->org.x == org.x && memo->org.y == org.y &&
+            memo->org.z == org.z && memo->dir.x == dir.x &&
+            memo->dir.y == dir.y && memo->dir.z == dir.z &&
+            memo->tnear == tnear && tfar <= memo->tfar) {
+          hit = memo->record;
+          return memo->hit && hit.t < tfar;
+        }
+      }
+
+      VSET(ap.a_ray.r_pt, org.x, org.y, org.z);
+      VSET(ap.a_ray.r_dir, dir.x, dir.y, dir.z);
+
+      bool didHit = false;
+
+      if (scene.proxyScene) {
+        float proxyT;
+        if (intersectProxy(scene, org, dir, tnear, tfar, proxyT)) {
+          // exact hit near the proxy first; if the proxy was too generous
+          // there, keep looking behind it
+          const float windowMin = std::max(tnear, proxyT - geom.refineDistance);
+          const float windowMax = std::min(tfar, proxyT + geom.refineDistance);
+
+          ap.a_ray.r_min = windowMin;
+          ap.a_ray.r_max = windowMax;
+          didHit = shoot(geom, ap);
+
+          if (!didHit && windowMax < tfar) {
+            ap.a_ray.r_min = windowMin;
+            ap.a_ray.r_max = tfar;
+            didHit = shoot(geom, ap);
+          }
+        }
+      } else {
+        ap.a_ray.r_min = tnear;
+        ap.a_ray.r_max = tfar;
+        didHit = shoot(geom, ap);
+      }
+
+      if (didHit && !scene.regionRemap.empty())
+        hit.primID = scene.regionRemap[hit.primID];
+
+      if (memo) {
+        memo->version  = scene.version;
+        memo->org      = org;
+        memo->dir      = dir;
+        memo->tnear    = tnear;
+        memo->tfar     = tfar;
+        memo->hit      = didHit;
+        memo->record   = hit;
+      }
+
+      return didHit;
+    }
+
+    /*! Clipped interval of the world space ray traceAssembly() is tracing
+        on this thread, for the cap of the piece that is hit */
+    static thread_local const ClipRange *assemblyClip = nullptr;
+
+    /*! Trace an instancing mode assembly. The pieces' callbacks defer
+        their hits like any other; the normal of the hit that survives is
+        then moved out of its instance's space. Returns whether anything was
+        hit in [tnear, tfar], with tfar, u/v and primID set. */
+    static bool traceAssembly(const BRLCAD &geom,
+                              const BRLCAD::Assembly &assembly,
+                              const vec3f &org,
+                              const vec3f &dir,
+                              float tnear,
+                              float &tfar,
+                              float &u,
+                              float &v,
+                              uint &primID)
+    {
+      // clipping is done out here, in world space: the pieces are handed
+      // the clipped interval by Embree, and the cap through 'assemblyClip'
+      ClipRange range(tnear, tfar);
+      if (!clipRay(geom, org, dir, range))
+        return false;
+
+      RTCRay ray = makeRay(org, dir, range.tnear, range.tfar);
+
+      assemblyClip = &range;
+      rtcIntersect(assembly.scene, ray);
+      assemblyClip = nullptr;
+
+      if (ray.geomID == RTC_INVALID_GEOMETRY_ID)
+        return false;
+
+      if (ray.instID != RTC_INVALID_GEOMETRY_ID) {
+        const DeferredHitHandle handle {int32_t(floatBits(ray.u)),
+                                        floatBits(ray.v)};
+        setDeferredHitTransform(handle, assembly.normalXfms[ray.instID].get());
+      }
+
+      tfar   = ray.tfar;
+      u      = ray.u;
+      v      = ray.v;
+      primID = ray.primID;
+      return true;
+    }
+
+    static bool occludeAssembly(const BRLCAD &geom,
+                                const BRLCAD::Assembly &assembly,
+                                const vec3f &org,
+                                const vec3f &dir,
+                                float tnear,
+                                float tfar)
+    {
+      ClipRange range(tnear, tfar);
+      if (!clipRay(geom, org, dir, range))
+        return false;
+
+      RTCRay ray = makeRay(org, dir, range.tnear, range.tfar);
 
-      auto hit = rt_shootray(&ap);
-      if (hit) {
+      rtcOccluded(assembly.scene, ray);
+
+      return ray.geomID == 0;
+    }
+
+    static bool traceRay(const BRLCAD &geom,
+                         const BRLCAD::Primitive &prim,
+                         RTCRay& ray)
+    {
+      const vec3f org(ray.org[0], ray.org[1], ray.org[2]);
+      const vec3f dir(ray.dir[0], ray.dir[1], ray.dir[2]);
+
+      if (prim.assembly) {
+        if (!traceAssembly(geom, *prim.assembly, org, dir, ray.tnear,
+                           ray.tfar, ray.u, ray.v, ray.primID)) {
+          return false;
+        }
+
+        ray.geomID = geom.geomID;
+        return true;
+      }
+
+      ClipRange range(ray.tnear, ray.tfar);
+      if (!clipRay(geom, org, dir, range))
+        return false;
+
+      const Scene *scene = primitiveScene(geom, prim);
+
+      if (!scene) {
+        float t;
+        if (!intersectPlaceholder(prim, org, dir,
+                                  range.tnear, range.tfar, t)) {
+          return false;
+        }
+
+        ray.tfar   = t;
+        ray.u      = bitsToFloat(PLACEHOLDER_HANDLE.slot);
+        ray.v      = bitsToFloat(PLACEHOLDER_HANDLE.seq);
+        ray.geomID = geom.geomID;
+        ray.primID = prim.primBase;
+        return true;
+      }
+
+      application ap;
+      HitRecord hit;
+
+      initApplication(*scene, ap, hit);
+
+      if (shootRay(geom, *scene, ap, hit, org, dir, range)) {
+        const auto handle = deferHit(hit.surface);
+        ray.tfar   = hit.t;
+        ray.u      = bitsToFloat(handle.slot);
+        ray.v      = bitsToFloat(handle.seq);
         ray.geomID = geom.geomID;
-        ray.primID = 0;
+        ray.primID = primitiveBase(prim) + hit.primID;
+        return true;
       }
+
+      return false;
     }
 
-    static void brlcadIntersect(const BRLCAD* geom_i, RTCRay& ray, size_t item)
+    /*! Whether at least two valid lanes start at the same point (returned
+        in 'origin') and all others too, as the primary rays of a packet of
+        neighbouring pixels do */
+    template<typename T>
+    static bool sharedOrigin(const int *valid,
+                             const T &rays,
+                             size_t N,
+                             vec3f &origin)
     {
-      const BRLCAD& geom = geom_i[item];
-      traceRay(geom, ray);
+      int first = -1;
+      int count = 0;
+      for (size_t i = 0; i < N; ++i) {
+        if (!valid[i])
+          continue;
+        if (first < 0) {
+          first = i;
+        } else if (rays.orgx[i] != rays.orgx[first] ||
+                   rays.orgy[i] != rays.orgy[first] ||
+                   rays.orgz[i] != rays.orgz[first]) {
+          return false;
+        }
+        count++;
+      }
+
+      if (count < 2)
+        return false;
+
+      origin = vec3f(rays.orgx[first], rays.orgy[first], rays.orgz[first]);
+      return true;
     }
 
-    static void brlcadIntersectN(const int*                 valid,
-                                 const BRLCAD*              geom_i,
-                                 const RTCIntersectContext* context,
-                                 RTCRayNp*                  rays,
-                                 size_t                     N,
-                                 size_t                     item)
+    /*! Motion mode version of tracePacket() for primary ray packets: every
+        'stride'th lane (from an offset that rotates from packet to packet)
+        is traced through librt, and every other lane takes the distance,
+        region and normal of the traced lane closest in direction. Lanes whose two closest traced
+        lanes disagree (hit vs. miss, different regions or depths) sit on an
+        edge and are traced as well. */
+    template<typename T>
+    static int traceSparsePacket(const BRLCAD &geom,
+                                 const BRLCAD::Primitive &prim,
+                                 const Scene &scene,
+                                 const int *valid,
+                                 T &rays,
+                                 size_t N,
+                                 int stride)
+    {
+      static thread_local uint32_t packetCount = 0;
+
+      const uint primBase = primitiveBase(prim);
+
+      application ap;
+      HitRecord hit;
+
+      initApplication(scene, ap, hit);
+
+      int lanes[MAX_PACKET_SIZE];
+      const int n = validLanes(valid, N, lanes);
+
+      if (n == 0)
+        return 0;
+
+      bool  traced[MAX_PACKET_SIZE] = {};
+      bool  didHit[MAX_PACKET_SIZE] = {};
+      float hitT[MAX_PACKET_SIZE];
+      uint  hitPrim[MAX_PACKET_SIZE];
+      DeferredHitHandle handles[MAX_PACKET_SIZE];
+
+      int hits = 0;
+      int shot = 0;
+
+      auto traceLane = [&](int i) {
+        const vec3f org(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+        const vec3f dir(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+
+        traced[i] = true;
+
+        ClipRange range(rays.tnear[i], rays.tfar[i]);
+        if (!clipRay(geom, org, dir, range))
+          return;
+
+        shot++;
+
+        if (shootRay(geom, scene, ap, hit, org, dir, range)) {
+          didHit[i]  = true;
+          hitT[i]    = hit.t;
+          hitPrim[i] = primBase + hit.primID;
+          handles[i] = deferHit(hit.surface);
+        }
+      };
+
+      const int offset = packetCount++ % stride;
+      for (int k = offset; k < n; k += stride)
+        traceLane(lanes[k]);
+      if (shot == 0)
+        traceLane(lanes[offset % n]);
+
+      // sparse lanes, in the same order so fills only use first pass lanes
+      int nearest[MAX_PACKET_SIZE][2];
+      for (int k = 0; k < n; ++k) {
+        const int j = lanes[k];
+        nearest[j][0] = nearest[j][1] = -1;
+        if (traced[j])
+          continue;
+
+        float best[2] = {-2.f, -2.f};
+        for (int m = 0; m < n; ++m) {
+          const int i = lanes[m];
+          if (!traced[i])
+            continue;
+
+          const float d = rays.dirx[i] * rays.dirx[j]
+                        + rays.diry[i] * rays.diry[j]
+                        + rays.dirz[i] * rays.dirz[j];
+          if (d > best[0]) {
+            best[1] = best[0];
+            nearest[j][1] = nearest[j][0];
+            best[0] = d;
+            nearest[j][0] = i;
+          } else if (d > best[1]) {
+            best[1] = d;
+            nearest[j][1] = i;
+          }
+        }
+      }
+
+      for (int k = 0; k < n; ++k) {
+        const int j = lanes[k];
+        if (traced[j])
+          continue;
+
+        const int a = nearest[j][0];
+        const int b = nearest[j][1];
+
+        const bool edge = b >= 0 &&
+            (didHit[a] != didHit[b] ||
+             (didHit[a] && (hitPrim[a] != hitPrim[b] ||
+                            std::abs(hitT[a] - hitT[b]) >
+                            0.05f * std::max(hitT[a], hitT[b]))));
+
+        if (edge) {
+          traceLane(j);
+        } else if (didHit[a]) {
+          // the borrowed hit has to lie in what this lane's clip planes
+          // and section box leave of it, or the lane is traced after all
+          const vec3f org(rays.orgx[j], rays.orgy[j], rays.orgz[j]);
+          const vec3f dir(rays.dirx[j], rays.diry[j], rays.dirz[j]);
+
+          ClipRange range(rays.tnear[j], rays.tfar[j]);
+          if (!clipRay(geom, org, dir, range))
+            continue;
+          if (range.capped || range.clipped) {
+            if (hitT[a] <= range.tnear || hitT[a] > range.tfar) {
+              traceLane(j);
+              continue;
+            }
+          } else if (hitT[a] < range.tnear || hitT[a] > range.tfar) {
+            continue;
+          }
+
+          // a hit of its own (the neighbour's normal, or one facing the
+          // ray if that has gone already), so no two lanes share a slot
+          vec3f normal = -dir;
+          evaluateDeferredHit(handles[a], normal);
+
+          DeferredHit surface;
+          surface.recordNormal(normal);
+
+          didHit[j]  = true;
+          hitT[j]    = hitT[a];
+          hitPrim[j] = hitPrim[a];
+          handles[j] = deferHit(surface);
+        }
+      }
+
+      for (int k = 0; k < n; ++k) {
+        const int i = lanes[k];
+        if (!didHit[i])
+          continue;
+
+        rays.tfar[i]   = hitT[i];
+        rays.u[i]      = bitsToFloat(handles[i].slot);
+        rays.v[i]      = bitsToFloat(handles[i].seq);
+        rays.geomID[i] = geom.geomID;
+        rays.primID[i] = hitPrim[i];
+        hits++;
+      }
+
+      geom.motion.countRays(shot);
+
+      return hits;
+    }
+
+    /*! tracePacket() for primary ray packets with the hit cache on: lanes
+        whose footprint is cached take the cached hit, the others are shot
+        and cached. The cache holds the first hit of the whole ray, past
+        'tfar', so it serves rays of any length: one that a closer geometry
+        (or, with 'regionPrimitives', a region primitive Embree visited
+        first) already shortened misses if it ends before the cached hit. */
+    template<typename T>
+    static int traceCachedPacket(const BRLCAD &geom,
+                                 const BRLCAD::Primitive &prim,
+                                 const Scene &scene,
+                                 const int *valid,
+                                 T &rays,
+                                 size_t N)
+    {
+      auto &cache = *geom.hitCache;
+      const uint32_t item = &prim - geom.primitives.data();
+      const uint primBase = primitiveBase(prim);
+
+      application ap;
+      HitRecord hit;
+
+      initApplication(scene, ap, hit);
+
+      int lanes[MAX_PACKET_SIZE];
+      const int n = validLanes(valid, N, lanes);
+
+      if (n == 0)
+        return 0;
+
+      const uint64_t generation = cache.currentGeneration();
+
+      int hits = 0;
+
+      for (int k = 0; k < n; ++k) {
+        const int i = lanes[k];
+
+        const vec3f org(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+        const vec3f dir(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+
+        CachedHit cached;
+        if (cache.lookup(generation, item, dir, cached) &&
+            (!cached.hit || cached.t >= rays.tnear[i])) {
+          if (cached.hit && cached.t <= rays.tfar[i]) {
+            DeferredHit surface;
+            surface.recordNormal(cached.normal);
+
+            const auto handle = deferHit(surface);
+            rays.tfar[i]   = cached.t;
+            rays.u[i]      = bitsToFloat(handle.slot);
+            rays.v[i]      = bitsToFloat(handle.seq);
+            rays.geomID[i] = geom.geomID;
+            rays.primID[i] = cached.primID;
+            hits++;
+          }
+          continue;
+        }
+
+        cached = CachedHit();
+
+        ClipRange range(rays.tnear[i], std::numeric_limits<float>::infinity());
+        if (clipRay(geom, org, dir, range) &&
+            shootRay(geom, scene, ap, hit, org, dir, range)) {
+          cached.hit    = true;
+          cached.t      = hit.t;
+          cached.normal = hit.surface.evaluate();
+          cached.primID = primBase + hit.primID;
+        }
+
+        if (cached.hit && cached.t <= rays.tfar[i]) {
+          const auto handle = deferHit(hit.surface);
+          rays.tfar[i]   = cached.t;
+          rays.u[i]      = bitsToFloat(handle.slot);
+          rays.v[i]      = bitsToFloat(handle.seq);
+          rays.geomID[i] = geom.geomID;
+          rays.primID[i] = cached.primID;
+          hits++;
+        }
+
+        cache.store(generation, item, dir, cached);
+      }
+
+      return hits;
+    }
+
+    /*! Trace the valid lanes of an SoA packet ('T' is either RTCRayNp or
+        RTCRayNt<N>), one rt_shootray() per lane. Only the setup is shared:
+        a single application (and resource) serves the whole packet, with
+        just the ray swapped in from lane to lane, while every lane still
+        walks librt's space partition on its own. Results are written
+        straight back into the packet instead of going through a scalar
+        RTCRay. Returns the number of lanes that hit. */
+    template<typename T>
+    static int tracePacket(const BRLCAD &geom,
+                            const BRLCAD::Primitive &prim,
+                            const int *valid,
+                            T &rays,
+                            size_t N)
     {
-      const BRLCAD& geom = geom_i[item];
+      if (prim.assembly) {
+        int hits = 0;
+        for (size_t i = 0; i < N; ++i) {
+          if (!valid[i])
+            continue;
+
+          const vec3f org(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+          const vec3f dir(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+
+          if (traceAssembly(geom, *prim.assembly, org, dir, rays.tnear[i],
+                            rays.tfar[i], rays.u[i], rays.v[i],
+                            rays.primID[i])) {
+            rays.geomID[i] = geom.geomID;
+            hits++;
+          }
+        }
+        return hits;
+      }
+
+      const Scene *scene = primitiveScene(geom, prim);
+
+      vec3f origin;
+      const bool primary = scene && (geom.motionBudget > 0.f || geom.hitCache)
+                           && sharedOrigin(valid, rays, N, origin);
+
+      if (primary && geom.motionBudget > 0.f) {
+        const int stride = geom.motion.stride(geom.motionBudget);
+        if (stride > 1)
+          return traceSparsePacket(geom, prim, *scene, valid, rays, N, stride);
+      }
+
+      // only rays from the camera's eye use the cache; other packets that
+      // happen to share an origin (say, from one surface point) do not
+      if (primary && geom.hitCache && geom.hitCache->holds(origin))
+        return traceCachedPacket(geom, prim, *scene, valid, rays, N);
+
+      application ap;
+      HitRecord hit;
 
-      for (int i = 0; i < N; ++i) {
-        if (valid[i]) {
-          RTCRay ray;
-          extractRay(*rays, ray, i);
-          traceRay(geom, ray);
-          insertRay(ray, *rays, i);
+      if (scene)
+        initApplication(*scene, ap, hit);
+
+      const uint primBase = scene ? primitiveBase(prim) : prim.primBase;
+
+      int lanes[MAX_PACKET_SIZE];
+      const int n = validLanes(valid, N, lanes);
+
+      int hits = 0;
+
+      for (int k = 0; k < n; ++k) {
+        const int i = lanes[k];
+
+        const vec3f org(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+        const vec3f dir(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+
+        ClipRange range(rays.tnear[i], rays.tfar[i]);
+        if (!clipRay(geom, org, dir, range))
+          continue;
+
+        if (!scene) {
+          float t;
+          if (intersectPlaceholder(prim, org, dir,
+                                   range.tnear, range.tfar, t)) {
+            rays.tfar[i]   = t;
+            rays.u[i]      = bitsToFloat(PLACEHOLDER_HANDLE.slot);
+            rays.v[i]      = bitsToFloat(PLACEHOLDER_HANDLE.seq);
+            rays.geomID[i] = geom.geomID;
+            rays.primID[i] = prim.primBase;
+            hits++;
+          }
+          continue;
+        }
+
+        if (shootRay(geom, *scene, ap, hit, org, dir, range)) {
+          const auto handle = deferHit(hit.surface);
+          rays.tfar[i]   = hit.t;
+          rays.u[i]      = bitsToFloat(handle.slot);
+          rays.v[i]      = bitsToFloat(handle.seq);
+          rays.geomID[i] = geom.geomID;
+          rays.primID[i] = primBase + hit.primID;
+          hits++;
         }
       }
+
+      return hits;
+    }
+
+    /*! Any-hit query for shadow/AO rays. librt stops after the first
+        partition, and when every region is a plain union (so any segment
+        is solid material) boolean weaving is skipped as well. */
+    static bool occludeRay(const BRLCAD &geom,
+                           const Scene &scene,
+                           application &ap,
+                           const vec3f &org,
+                           const vec3f &dir,
+                           float tnear,
+                           float tfar)
+    {
+      float proxyT;
+      if (scene.proxyScene &&
+          !intersectProxy(scene, org, dir, tnear, tfar, proxyT)) {
+        return false;
+      }
+
+      VSET(ap.a_ray.r_pt, org.x, org.y, org.z);
+      VSET(ap.a_ray.r_dir, dir.x, dir.y, dir.z);
+      ap.a_ray.r_min = tnear;
+      ap.a_ray.r_max = tfar;
+
+      return shoot(geom, ap);
+    }
+
+    static void initOcclusionApplication(const Scene &scene, application &ap)
+    {
+      RT_APPLICATION_INIT(&ap);
+
+      ap.a_rt_i = scene.rtip;
+      ap.a_onehit = 1;
+      ap.a_no_booleans = scene.unionsOnly;
+
+      ap.a_resource = scene.resources.local();
+
+      ap.a_hit  = occludedCallback;
+      ap.a_miss = missCallback;
+    }
+
+    // NOTE: the user data pointer is the BRLCAD geometry itself; 'item' is the
+    //       Embree primitive (a whole scene, or one region) being tested
+
+    static void brlcadIntersect(const BRLCAD* geom, RTCRay& ray, size_t item)
+    {
+      const bool hit = traceRay(*geom, geom->primitives[item], ray);
+
+      if (geom->collectStats)
+        countCall(STATS_INTERSECT, 1, 1, hit);
     }
 
     template<int SIZE>
     static void brlcadIntersectNt(const int*       mask,
-                                  const BRLCAD*    geom_i,
-                                  RTCRayNt<SIZE>&  _rays,
+                                  const BRLCAD*    geom,
+                                  RTCRayNt<SIZE>&  rays,
                                   size_t           item)
     {
-      RTCIntersectContext ctx;
-      RTCRayNp rays {_rays.orgx, _rays.orgy, _rays.orgz, _rays.dirx, _rays.diry,
-                     _rays.dirz, _rays.tnear, _rays.tfar, _rays.time,
-                     _rays.mask, _rays.Ngx, _rays.Ngy, _rays.Ngz, _rays.u,
-                     _rays.v, _rays.geomID, _rays.primID, _rays.instID};
-      brlcadIntersectN(mask, geom_i, &ctx, &rays, SIZE, item);
+      const int hits = tracePacket(*geom, geom->primitives[item],
+                                   mask, rays, SIZE);
+
+      if (geom->collectStats)
+        countCall(STATS_INTERSECT, SIZE, countValid(mask, SIZE), hits);
+    }
+
+    /*! Contiguous SoA arrays handed over by BRLCAD_intersect() in
+        brlcad.ispc, shaped like an RTCRayNt so tracePacket() takes them */
+    struct PackedRays
+    {
+      const float *orgx, *orgy, *orgz;
+      const float *dirx, *diry, *dirz;
+      const float *tnear;
+      float *tfar;
+      float *u;
+      float *v;
+      uint32_t *geomID;
+      uint32_t *primID;
+    };
+
+    // NOTE: called from BRLCAD_intersect() with the compacted active lanes
+    //       of a varying ray, so every one of the 'n' lanes is valid
+    extern "C" int BRLCAD_intersectPacked(void *geom_i,
+                                          uint64_t item,
+                                          int32_t width,
+                                          int32_t n,
+                                          const float *orgx,
+                                          const float *orgy,
+                                          const float *orgz,
+                                          const float *dirx,
+                                          const float *diry,
+                                          const float *dirz,
+                                          const float *tnear,
+                                          float *tfar,
+                                          float *u,
+                                          float *v,
+                                          uint32_t *geomID,
+                                          uint32_t *primID)
+    {
+      const auto &geom = *static_cast<const BRLCAD*>(geom_i);
+
+      PackedRays rays {orgx, orgy, orgz, dirx, diry, dirz,
+                       tnear, tfar, u, v, geomID, primID};
+
+      int valid[MAX_PACKET_SIZE];
+      std::fill(valid, valid + n, -1);
+
+      const int hits = tracePacket(geom, geom.primitives[item], valid, rays, n);
+
+      if (geom.collectStats)
+        countCall(STATS_INTERSECT, width, n, hits);
+
+      return hits;
+    }
+
+    // NOTE: Embree marks an occluded ray by setting its geomID to 0
+
+    static void brlcadOccluded(const BRLCAD* geom, RTCRay& ray, size_t item)
+    {
+      const auto &prim = geom->primitives[item];
+      const Scene *scene = primitiveScene(*geom, prim);
+
+      const vec3f org(ray.org[0], ray.org[1], ray.org[2]);
+      const vec3f dir(ray.dir[0], ray.dir[1], ray.dir[2]);
+
+      bool occluded = false;
+
+      if (prim.assembly) {
+        occluded = occludeAssembly(*geom, *prim.assembly, org, dir,
+                                   ray.tnear, ray.tfar);
+      } else {
+        ClipRange range(ray.tnear, ray.tfar);
+        if (!clipRay(*geom, org, dir, range)) {
+          occluded = false;
+        } else if (scene) {
+          application ap;
+          initOcclusionApplication(*scene, ap);
+          occluded = occludeRay(*geom, *scene, ap,
+                                org, dir, range.tnear, range.tfar);
+        } else {
+          float t;
+          occluded = intersectPlaceholder(prim, org, dir,
+                                          range.tnear, range.tfar, t);
+        }
+      }
+
+      if (occluded)
+        ray.geomID = 0;
+
+      if (geom->collectStats)
+        countCall(STATS_OCCLUDED, 1, 1, occluded);
+    }
+
+    /*! Occlusion counterpart of tracePacket(): marks the valid lanes of
+        'rays' that are blocked, returning how many are */
+    template<typename T>
+    static int occludePacket(const BRLCAD &geom,
+                             const BRLCAD::Primitive &prim,
+                             const int *mask,
+                             T &rays,
+                             size_t N)
+    {
+      const Scene *scene = primitiveScene(geom, prim);
+
+      application ap;
+      if (scene)
+        initOcclusionApplication(*scene, ap);
+
+      int lanes[MAX_PACKET_SIZE];
+      const int n = validLanes(mask, N, lanes);
+
+      int occluded = 0;
+
+      for (int k = 0; k < n; ++k) {
+        const int i = lanes[k];
+
+        const vec3f org(rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+        const vec3f dir(rays.dirx[i], rays.diry[i], rays.dirz[i]);
+
+        bool blocked = false;
+
+        if (prim.assembly) {
+          blocked = occludeAssembly(geom, *prim.assembly, org, dir,
+                                    rays.tnear[i], rays.tfar[i]);
+        } else {
+          ClipRange range(rays.tnear[i], rays.tfar[i]);
+          if (!clipRay(geom, org, dir, range))
+            continue;
+
+          float t;
+          blocked = scene ? occludeRay(geom, *scene, ap, org, dir,
+                                       range.tnear, range.tfar)
+                          : intersectPlaceholder(prim, org, dir,
+                                                 range.tnear, range.tfar, t);
+        }
+
+        if (blocked) {
+          rays.geomID[i] = 0;
+          occluded++;
+        }
+      }
+
+      return occluded;
+    }
+
+    template<int SIZE>
+    static void brlcadOccludedNt(const int*       mask,
+                                 const BRLCAD*    geom,
+                                 RTCRayNt<SIZE>&  rays,
+                                 size_t           item)
+    {
+      const int occluded = occludePacket(*geom, geom->primitives[item],
+                                         mask, rays, SIZE);
+
+      if (geom->collectStats)
+        countCall(STATS_OCCLUDED, SIZE, countValid(mask, SIZE), occluded);
+    }
+
+    // Ray reordering /////////////////////////////////////////////////////////
+
+    /*! Up to MAX_PACKET_SIZE rays gathered out of an RTCRayN stream in the
+        order they are to be shot, shaped like an RTCRayNt so tracePacket()
+        and occludePacket() take them; 'lane' is where each came from */
+    struct GatheredRays
+    {
+      float orgx[MAX_PACKET_SIZE], orgy[MAX_PACKET_SIZE], orgz[MAX_PACKET_SIZE];
+      float dirx[MAX_PACKET_SIZE], diry[MAX_PACKET_SIZE], dirz[MAX_PACKET_SIZE];
+      float tnear[MAX_PACKET_SIZE];
+      float tfar[MAX_PACKET_SIZE];
+      float u[MAX_PACKET_SIZE];
+      float v[MAX_PACKET_SIZE];
+      uint32_t geomID[MAX_PACKET_SIZE];
+      uint32_t primID[MAX_PACKET_SIZE];
+      size_t lane[MAX_PACKET_SIZE];
+    };
+
+    /*! Buffer the valid rays of a stream, sort them by rayOrderKey() and
+        hand them to 'shoot' (tracePacket() or occludePacket()) in chunks
+        of MAX_PACKET_SIZE, scattering the results back to their own lanes;
+        returns the sum of what 'shoot' returned */
+    template<typename F>
+    static int shootReordered(const BRLCAD::Primitive &prim,
+                              const int *valid,
+                              RTCRayN *rays,
+                              size_t N,
+                              const F &shoot)
+    {
+      // (key, lane): ties keep lane order, so results do not depend on the
+      // sort; the buffer only grows, once per thread
+      static thread_local std::vector<std::pair<uint64_t, size_t>> order;
+
+      order.clear();
+      for (size_t i = 0; i < N; ++i) {
+        if (!valid[i])
+          continue;
+
+        const vec3f org(RTCRayN_org_x(rays, N, i),
+                        RTCRayN_org_y(rays, N, i),
+                        RTCRayN_org_z(rays, N, i));
+        const vec3f dir(RTCRayN_dir_x(rays, N, i),
+                        RTCRayN_dir_y(rays, N, i),
+                        RTCRayN_dir_z(rays, N, i));
+        order.emplace_back(rayOrderKey(prim.bounds, org, dir), i);
+      }
+
+      std::sort(order.begin(), order.end());
+
+      int chunkValid[MAX_PACKET_SIZE];
+      std::fill(chunkValid, chunkValid + MAX_PACKET_SIZE, -1);
+
+      GatheredRays chunk;
+      int result = 0;
+
+      for (size_t first = 0; first < order.size(); first += MAX_PACKET_SIZE) {
+        const size_t n = std::min<size_t>(MAX_PACKET_SIZE,
+                                          order.size() - first);
+
+        for (size_t k = 0; k < n; ++k) {
+          const size_t i = order[first + k].second;
+          chunk.lane[k]   = i;
+          chunk.orgx[k]   = RTCRayN_org_x(rays, N, i);
+          chunk.orgy[k]   = RTCRayN_org_y(rays, N, i);
+          chunk.orgz[k]   = RTCRayN_org_z(rays, N, i);
+          chunk.dirx[k]   = RTCRayN_dir_x(rays, N, i);
+          chunk.diry[k]   = RTCRayN_dir_y(rays, N, i);
+          chunk.dirz[k]   = RTCRayN_dir_z(rays, N, i);
+          chunk.tnear[k]  = RTCRayN_tnear(rays, N, i);
+          chunk.tfar[k]   = RTCRayN_tfar(rays, N, i);
+          chunk.u[k]      = RTCRayN_u(rays, N, i);
+          chunk.v[k]      = RTCRayN_v(rays, N, i);
+          chunk.geomID[k] = RTCRayN_geomID(rays, N, i);
+          chunk.primID[k] = RTCRayN_primID(rays, N, i);
+        }
+
+        result += shoot(chunkValid, chunk, n);
+
+        for (size_t k = 0; k < n; ++k) {
+          const size_t i = chunk.lane[k];
+          RTCRayN_tfar(rays, N, i)   = chunk.tfar[k];
+          RTCRayN_u(rays, N, i)      = chunk.u[k];
+          RTCRayN_v(rays, N, i)      = chunk.v[k];
+          RTCRayN_geomID(rays, N, i) = chunk.geomID[k];
+          RTCRayN_primID(rays, N, i) = chunk.primID[k];
+        }
+      }
+
+      return result;
+    }
+
+    // NOTE: with 'reorderRays' these are the only packet callbacks, so Embree
+    //       hands them packets of every width as well as ray streams
+
+    static void brlcadIntersectN(const int*                 valid,
+                                 void*                      geom_i,
+                                 const RTCIntersectContext* /*context*/,
+                                 RTCRayN*                   rays,
+                                 size_t                     N,
+                                 size_t                     item)
+    {
+      const auto &geom = *static_cast<const BRLCAD*>(geom_i);
+      const auto &prim = geom.primitives[item];
+
+      const int hits = shootReordered(prim, valid, rays, N,
+          [&](const int *mask, GatheredRays &chunk, size_t n) {
+            return tracePacket(geom, prim, mask, chunk, n);
+          });
+
+      if (geom.collectStats)
+        countCall(STATS_INTERSECT, N, countValid(valid, N), hits);
+    }
+
+    static void brlcadOccludedN(const int*                 valid,
+                                void*                      geom_i,
+                                const RTCIntersectContext* /*context*/,
+                                RTCRayN*                   rays,
+                                size_t                     N,
+                                size_t                     item)
+    {
+      const auto &geom = *static_cast<const BRLCAD*>(geom_i);
+      const auto &prim = geom.primitives[item];
+
+      const int occluded = shootReordered(prim, valid, rays, N,
+          [&](const int *mask, GatheredRays &chunk, size_t n) {
+            return occludePacket(geom, prim, mask, chunk, n);
+          });
+
+      if (geom.collectStats)
+        countCall(STATS_OCCLUDED, N, countValid(valid, N), occluded);
     }
 
     static void brlcadBounds(void *geom_i, size_t item, RTCBounds &bounds_o)
     {
-      const auto& geom = ((const BRLCAD*)geom_i)[item];
-      bounds_o.lower_x = geom.bounds.lower.x;
-      bounds_o.lower_y = geom.bounds.lower.y;
-      bounds_o.lower_z = geom.bounds.lower.z;
-      bounds_o.upper_x = geom.bounds.upper.x;
-      bounds_o.upper_y = geom.bounds.upper.y;
-      bounds_o.upper_z = geom.bounds.upper.z;
+      const auto& geom = *static_cast<const BRLCAD*>(geom_i);
+      const auto& box  = geom.primitives[item].bounds;
+      bounds_o.lower_x = box.lower.x;
+      bounds_o.lower_y = box.lower.y;
+      bounds_o.lower_z = box.lower.z;
+      bounds_o.upper_x = box.upper.x;
+      bounds_o.upper_y = box.upper.y;
+      bounds_o.upper_z = box.upper.z;
+    }
+
+    // NOTE: assembly pieces are traced from traceAssembly(), in their own
+    //       Embree scenes: rays arrive in the part's space, where a scaled
+    //       placement leaves their direction off unit length, which librt
+    //       does not expect, so they are shot normalized and scaled back
+
+    /*! 'ray' with a unit direction, and the length that was divided out */
+    inline static RTCRay unitRay(const RTCRay &ray, float &len)
+    {
+      const vec3f dir(ray.dir[0], ray.dir[1], ray.dir[2]);
+      len = length(dir);
+
+      RTCRay unit = ray;
+      unit.dir[0] = dir.x / len;
+      unit.dir[1] = dir.y / len;
+      unit.dir[2] = dir.z / len;
+      unit.tnear  = ray.tnear * len;
+      unit.tfar   = ray.tfar * len;
+      return unit;
+    }
+
+    static void pieceIntersect(const BRLCAD::AssemblyPiece *piece,
+                               RTCRay &ray,
+                               size_t item)
+    {
+      float len;
+      const RTCRay unit = unitRay(ray, len);
+
+      const vec3f org(unit.org[0], unit.org[1], unit.org[2]);
+      const vec3f dir(unit.dir[0], unit.dir[1], unit.dir[2]);
+
+      // the ray is already clipped, but caps are decided in world space
+      ClipRange range(unit.tnear, unit.tfar);
+      if (assemblyClip) {
+        range.clipped   = assemblyClip->clipped;
+        range.capped    = assemblyClip->capped;
+        range.capNormal = assemblyClip->capNormal;
+      }
+
+      const auto &prim = piece->prim;
+
+      application ap;
+      HitRecord hit;
+
+      initApplication(*prim.scene, ap, hit);
+
+      if (shootRay(*piece->geom, *prim.scene, ap, hit, org, dir, range)) {
+        const auto handle = deferHit(hit.surface);
+        ray.tfar   = hit.t / len;
+        ray.u      = bitsToFloat(handle.slot);
+        ray.v      = bitsToFloat(handle.seq);
+        ray.geomID = piece->geomID;
+        ray.primID = prim.primBase + hit.primID;
+      }
+    }
+
+    static void pieceOccluded(const BRLCAD::AssemblyPiece *piece,
+                              RTCRay &ray,
+                              size_t item)
+    {
+      float len;
+      const RTCRay unit = unitRay(ray, len);
+
+      const vec3f org(unit.org[0], unit.org[1], unit.org[2]);
+      const vec3f dir(unit.dir[0], unit.dir[1], unit.dir[2]);
+
+      application ap;
+      initOcclusionApplication(*piece->prim.scene, ap);
+      if (occludeRay(*piece->geom, *piece->prim.scene, ap,
+                     org, dir, unit.tnear, unit.tfar)) {
+        ray.geomID = 0;
+      }
+    }
+
+    static void pieceBounds(void *piece_i, size_t item, RTCBounds &bounds_o)
+    {
+      const auto& box = static_cast<const BRLCAD::AssemblyPiece*>(piece_i)
+                            ->prim.bounds;
+      bounds_o.lower_x = box.lower.x;
+      bounds_o.lower_y = box.lower.y;
+      bounds_o.lower_z = box.lower.z;
+      bounds_o.upper_x = box.upper.x;
+      bounds_o.upper_y = box.upper.y;
+      bounds_o.upper_z = box.upper.z;
+    }
+
+    /*! Add 'piece' to 'scene' as a user geometry of its own */
+    static uint addPiece(RTCScene scene, BRLCAD::AssemblyPiece *piece)
+    {
+      const uint id = rtcNewUserGeometry(scene, 1);
+
+      rtcSetUserData(scene, id, piece);
+      rtcSetBoundsFunction(scene, id, pieceBounds);
+      rtcSetIntersectFunction(scene, id, (RTCIntersectFunc)&pieceIntersect);
+      rtcSetOccludedFunction(scene, id, (RTCOccludedFunc)&pieceOccluded);
+
+      return id;
+    }
+
+    // NOTE: called from BRLCAD_postIntersect() with the u/v of the hit
+    extern "C" int BRLCAD_deferredNormal(int32_t slot,
+                                         uint32_t seq,
+                                         float *Ng)
+    {
+      vec3f normal;
+      if (!evaluateDeferredHit({slot, seq}, normal))
+        return 0;
+
+      Ng[0] = normal.x;
+      Ng[1] = normal.y;
+      Ng[2] = normal.z;
+      return 1;
     }
 
     // BRLCAD Geometry definitions ////////////////////////////////////////////
 
+    // NOTE: live geometries, so memory can be accounted (and trimmed) from
+    //       outside a commit, see ospray_brlcad_account_memory()
+    static std::mutex liveMutex;
+    static std::set<BRLCAD*> liveGeometries;
+
     BRLCAD::BRLCAD()
     {
       this->ispcEquivalent = ispc::BRLCAD_create(this);
+
+      std::lock_guard<std::mutex> lock(liveMutex);
+      liveGeometries.insert(this);
     }
 
     BRLCAD::~BRLCAD()
     {
+      {
+        std::lock_guard<std::mutex> lock(liveMutex);
+        liveGeometries.erase(this);
+      }
+
       ispc::BRLCAD_destroy(ispcEquivalent);
     }
 
+    BRLCAD::Assembly::~Assembly()
+    {
+      if (scene)
+        rtcDeleteScene(scene);
+
+      for (auto partScene : partScenes)
+        rtcDeleteScene(partScene);
+    }
+
+    std::set<const Scene*> BRLCAD::distinctScenes() const
+    {
+      // each scene also serves as the replica of one node, so it is only
+      // listed once
+      std::set<const Scene*> all;
+      for (const auto &scene : scenes)
+        all.insert(scene.get());
+      for (const auto &nodeScenes : replicaPtrs)
+        all.insert(nodeScenes.begin(), nodeScenes.end());
+      return all;
+    }
+
+    void BRLCAD::setUpHitCache()
+    {
+      // anything a commit changes may change the hits, so cached ones are
+      // only kept across frames, never across commits
+      const float footprint = getParam1f("hitCache", 0.f);
+      if (footprint <= 0.f) {
+        hitCache = nullptr;
+        return;
+      }
+
+      // the table is the largest that fits next to the scenes under the
+      // cap (a table cannot shrink while rays use it, so only here)
+      int log2Size = HitCache::MAX_LOG2_SIZE;
+      if (memoryCap > 0) {
+        size_t used = 0;
+        for (const auto *scene : distinctScenes())
+          used += scene->prepBytes + scene->resources.memoryUsage();
+
+        const size_t headroom = used < memoryCap ? memoryCap - used : 0;
+        while (log2Size >= HitCache::MIN_LOG2_SIZE &&
+               HitCache::bytesFor(log2Size) > headroom) {
+          log2Size--;
+        }
+
+        if (log2Size < HitCache::MIN_LOG2_SIZE) {
+          hitCache = nullptr;
+          postStatusMsg("#osp:brlcad: no room for the hit cache under"
+                        " 'memoryCap', tracing without it\n");
+          return;
+        }
+      }
+
+      if (!hitCache || hitCache->footprint != footprint ||
+          hitCache->log2Size != log2Size) {
+        hitCache.reset(new HitCache(footprint, log2Size));
+      }
+
+      const float nan = std::numeric_limits<float>::quiet_NaN();
+      hitCache->invalidate(getParam3f("hitCacheEye", vec3f(nan)));
+    }
+
+    void BRLCAD::accountMemory(bool report)
+    {
+      const auto all = distinctScenes();
+
+      size_t prepBytes = 0, resourceBytes = 0;
+      for (const auto *scene : all) {
+        prepBytes     += scene->prepBytes;
+        resourceBytes += scene->resources.memoryUsage();
+      }
+
+      const size_t cacheBytes = hitCache ? hitCache->bytes() : 0;
+
+      const bool overCap = memoryCap > 0 &&
+                           prepBytes + resourceBytes + cacheBytes > memoryCap;
+
+      // prepped data cannot shrink short of unloading, so trimming the
+      // per-thread free lists is all a cap can do
+      if (overCap) {
+        for (const auto *scene : all)
+          scene->resources.trim();
+      }
+
+      if (report || overCap) {
+        std::stringstream msg;
+        msg << std::fixed << std::setprecision(1)
+            << "#osp:brlcad: '" << (database ? database->filename : "")
+            << "' memory: prep " << prepBytes / 1048576.0 << " MB, librt"
+            << " resources " << resourceBytes / 1048576.0 << " MB";
+        if (hitCache)
+          msg << ", hit cache " << cacheBytes / 1048576.0 << " MB";
+        if (memoryCap > 0) {
+          msg << " (cap " << memoryCap / 1048576.0 << " MB"
+              << (overCap ? ", resources trimmed" : "") << ")";
+        }
+        msg << "\n";
+        postStatusMsg(msg);
+      }
+    }
+
+    void BRLCAD::accountAllMemory(bool report)
+    {
+      std::lock_guard<std::mutex> lock(liveMutex);
+
+      for (auto *geom : liveGeometries) {
+        // geometries in the middle of a commit are accounted by it
+        std::unique_lock<std::mutex> commitLock(geom->commitMutex,
+                                                std::try_to_lock);
+        if (commitLock)
+          geom->accountMemory(report);
+      }
+    }
+
+    /*! The live geometry behind OSPGeometry handle 'geometry', or null;
+        the caller holds 'liveMutex' */
+    static BRLCAD *findLiveGeometry(const void *geometry)
+    {
+      // handles of the local device are the objects themselves; anything
+      // else is simply not found
+      auto found = std::find_if(liveGeometries.begin(), liveGeometries.end(),
+          [&](BRLCAD *geom) {
+            return static_cast<const void*>(
+                static_cast<ospray::Geometry*>(geom)) == geometry;
+          });
+      return found != liveGeometries.end() ? *found : nullptr;
+    }
+
+    bool BRLCAD::regionInfo(const void *geometry,
+                            uint primID,
+                            ospray_brlcad_region &info)
+    {
+      std::lock_guard<std::mutex> lock(liveMutex);
+
+      auto *found = findLiveGeometry(geometry);
+      if (!found)
+        return false;
+
+      // waiting for a commit here would hold up everything else that needs
+      // 'liveMutex', so a geometry in the middle of one is not asked
+      auto &geom = *found;
+      std::unique_lock<std::mutex> commitLock(geom.commitMutex,
+                                              std::try_to_lock);
+      if (!commitLock)
+        return false;
+
+      if (primID >= geom.regionTable.size())
+        return false;
+
+      const auto *regp = geom.regionTable[primID];
+      if (regp == REGION_NULL)
+        return false;
+
+      info.name       = regp->reg_name;
+      info.regionID   = regp->reg_regionid;
+      info.aircode    = regp->reg_aircode;
+      info.materialID = regp->reg_gmater;
+
+      const auto &mater = regp->reg_mater;
+      for (int i = 0; i < 3; ++i)
+        info.color[i] = mater.ma_color_valid ? mater.ma_color[i] : 1.f;
+
+      return true;
+    }
+
+    bool BRLCAD::loadStats(const void *geometry,
+                           ospray_brlcad_load_stats &stats)
+    {
+      std::lock_guard<std::mutex> lock(liveMutex);
+
+      auto *found = findLiveGeometry(geometry);
+      if (!found)
+        return false;
+
+      auto &geom = *found;
+      std::unique_lock<std::mutex> commitLock(geom.commitMutex,
+                                              std::try_to_lock);
+      if (!commitLock)
+        return false;
+
+      stats = ospray_brlcad_load_stats();
+      for (const auto *scene : geom.distinctScenes()) {
+        stats.treeSeconds     += scene->treeSeconds;
+        stats.prepSeconds     += scene->prepSeconds;
+        stats.resourceSeconds += scene->resourceSeconds;
+        stats.scenes++;
+        if (scene->prepCacheHit)
+          stats.prepCacheHits++;
+      }
+
+      return true;
+    }
+
+    void BRLCAD::noteAllMotion()
+    {
+      std::lock_guard<std::mutex> lock(liveMutex);
+
+      for (auto *geom : liveGeometries)
+        geom->motion.noteMotion();
+    }
+
+    bool BRLCAD::anyMotionSettled()
+    {
+      std::lock_guard<std::mutex> lock(liveMutex);
+
+      // every geometry's flag is consumed, not just the first one set
+      bool settled = false;
+      for (auto *geom : liveGeometries)
+        settled = geom->motion.settled() || settled;
+      return settled;
+    }
+
+    void BRLCAD::loadScenes(std::shared_ptr<Database> db,
+                            std::vector<std::string> nextObjects,
+                            const std::string &cacheDir,
+                            const rt_tess_tol *proxyTol)
+    {
+      // Scenes come from the process-wide registry: objects this geometry
+      // already had, or that another geometry has loaded, are shared and
+      // only the rest get walked and prepped; dropping the last reference
+      // to a removed object releases it. Objects are loaded concurrently;
+      // one that fails is left out, and tried again by the next commit.
+      const auto start = std::chrono::steady_clock::now();
+
+      std::mutex progressMutex;
+      std::vector<char> created(nextObjects.size(), 0);
+      std::vector<std::string> errors(nextObjects.size());
+      size_t acquired = 0;
+      const size_t progressStep = std::max<size_t>(1, nextObjects.size() / 10);
+
+      auto nextScenes = acquireScenes(db, nextObjects, cacheDir, proxyTol,
+          [&](size_t i, const std::shared_ptr<Scene> &scene, bool wasCreated) {
+            created[i] = wasCreated;
+
+            std::lock_guard<std::mutex> lock(progressMutex);
+            if (++acquired % progressStep == 0 && nextObjects.size() > 1) {
+              postStatusMsg("#osp:brlcad: '" + db->filename + "': " +
+                            std::to_string(acquired) + "/" +
+                            std::to_string(nextObjects.size()) +
+                            " object(s) loaded\n");
+            }
+          },
+          [&](size_t i, const std::string &error) {
+            errors[i] = error;
+          });
+
+      // the failed objects are dropped here, so 'scenes' and 'objects' only
+      // hold the ones traced
+      size_t failed = 0;
+      for (size_t i = 0; i < nextObjects.size(); ++i) {
+        if (errors[i].empty()) {
+          if (failed > 0) {
+            nextObjects[i - failed] = std::move(nextObjects[i]);
+            nextScenes[i - failed]  = std::move(nextScenes[i]);
+            created[i - failed]     = created[i];
+          }
+          continue;
+        }
+
+        postStatusMsg("#osp:brlcad: could not load '" + nextObjects[i] +
+                      "': " + errors[i] + ", leaving it out\n");
+        failed++;
+      }
+
+      nextObjects.resize(nextObjects.size() - failed);
+      nextScenes.resize(nextScenes.size() - failed);
+
+      const std::chrono::duration<double> loadTime =
+          std::chrono::steady_clock::now() - start;
+
+      size_t kept = 0, shared = 0, loaded = 0, cacheHits = 0;
+      double treeSeconds = 0.0, prepSeconds = 0.0, resourceSeconds = 0.0;
+
+      for (size_t i = 0; i < nextScenes.size(); ++i) {
+        const auto &scene = nextScenes[i];
+        if (created[i]) {
+          cacheHits       += scene->prepCacheHit;
+          treeSeconds     += scene->treeSeconds;
+          prepSeconds     += scene->prepSeconds;
+          resourceSeconds += scene->resourceSeconds;
+          loaded++;
+        } else if (std::find(scenes.begin(), scenes.end(), scene)
+                   != scenes.end()) {
+          kept++;
+        } else {
+          shared++;
+        }
+      }
+
+      const size_t released = scenes.size() - kept;
+
+      database  = db;
+      scenes    = std::move(nextScenes);
+      objects   = std::move(nextObjects);
+      asyncLoad = nullptr;
+      assembly  = nullptr;
+
+      {
+        std::stringstream msg;
+        msg << "#osp:brlcad: '" << database->filename << "': " << kept
+            << " object(s) kept, " << shared << " shared, " << loaded
+            << " loaded";
+        if (failed > 0)
+          msg << ", " << failed << " failed";
+        if (!cacheDir.empty())
+          msg << " (" << cacheHits << " prep cache hit(s))";
+        msg << ", " << released << " released\n";
+        if (loaded > 0) {
+          msg << std::fixed << std::setprecision(3)
+              << "#osp:brlcad:   " << loadTime.count() << "s: directory "
+              << db->dirbuildSeconds << "s, then summed over objects: tree"
+              << " walk " << treeSeconds << "s, prep " << prepSeconds
+              << "s, resources " << resourceSeconds << "s\n";
+        }
+        postStatusMsg(msg);
+      }
+
+      bounds = empty;
+      for (const auto &scene : scenes)
+        bounds.extend(scene->bounds);
+    }
+
+    void BRLCAD::loadInstancedScenes(std::shared_ptr<Database> db,
+                                     std::vector<std::string> nextObjects,
+                                     const std::string &cacheDir,
+                                     const rt_tess_tol *proxyTol)
+    {
+      const auto start = std::chrono::steady_clock::now();
+
+      // parts are gathered over all objects, so a subassembly shared between
+      // them is prepped once as well
+      std::vector<std::string> partNames;
+      std::vector<std::vector<affine3f>> placements;
+      std::vector<std::vector<std::string>> remainders;
+
+      for (const auto &obj : nextObjects) {
+        auto plan = planInstances(*db, obj, instancing);
+
+        for (auto &part : plan.parts) {
+          auto found = std::find(partNames.begin(), partNames.end(), part.name);
+          if (found == partNames.end()) {
+            partNames.push_back(part.name);
+            placements.emplace_back();
+            found = partNames.end() - 1;
+          }
+
+          auto &into = placements[found - partNames.begin()];
+          into.insert(into.end(),
+                      part.placements.begin(), part.placements.end());
+        }
+
+        if (!plan.remainder.empty())
+          remainders.push_back(std::move(plan.remainder));
+      }
+
+      // parts are whole combinations, so they are shared through the
+      // registry like objects are; remainders only make sense to this plan
+      auto nextScenes = acquireScenes(db, partNames, cacheDir, proxyTol);
+      for (const auto &paths : remainders) {
+        nextScenes.push_back(std::make_shared<Scene>(db, paths, cacheDir,
+                                                     proxyTol));
+      }
+
+      std::unique_ptr<Assembly> next(new Assembly);
+
+      auto device = (RTCDevice)ospray_getEmbreeDevice();
+      next->scene = rtcDeviceNewScene(device, RTC_SCENE_STATIC,
+                                      RTC_INTERSECT1);
+
+      size_t numInstances = 0;
+      uint primBase = 0;
+
+      for (size_t i = 0; i < nextScenes.size(); ++i) {
+        const auto &scene = nextScenes[i];
+        const bool isPart = i < partNames.size();
+
+        std::unique_ptr<AssemblyPiece> piece(new AssemblyPiece {
+          this, {scene.get(), -1, scene->bounds, primBase,
+                 nullptr, 0, nullptr, nullptr}, 0
+        });
+
+        if (isPart) {
+          auto partScene = rtcDeviceNewScene(device, RTC_SCENE_STATIC,
+                                             RTC_INTERSECT1);
+          next->partScenes.push_back(partScene);
+
+          piece->geomID = addPiece(partScene, piece.get());
+          rtcCommit(partScene);
+
+          for (const auto &xfm : placements[i]) {
+            const uint instID = rtcNewInstance2(next->scene, partScene);
+            rtcSetTransform2(next->scene, instID, RTC_MATRIX_COLUMN_MAJOR,
+                             &xfm.l.vx.x);
+
+            next->normalXfms.resize(std::max<size_t>(next->normalXfms.size(),
+                                                     instID + 1));
+            next->normalXfms[instID].reset(
+                new linear3f(xfm.l.inverse().transposed()));
+            numInstances++;
+          }
+        } else {
+          piece->geomID = addPiece(next->scene, piece.get());
+          next->normalXfms.resize(std::max<size_t>(next->normalXfms.size(),
+                                                   piece->geomID + 1));
+        }
+
+        next->pieces.push_back(std::move(piece));
+        primBase += scene->regionBounds.size();
+      }
+
+      rtcCommit(next->scene);
+
+      RTCBounds sceneBounds;
+      rtcGetBounds(next->scene, sceneBounds);
+
+      database  = db;
+      scenes    = std::move(nextScenes);
+      objects   = std::move(nextObjects);
+      asyncLoad = nullptr;
+      assembly  = std::move(next);
+
+      bounds = box3f(vec3f(sceneBounds.lower_x,
+                           sceneBounds.lower_y,
+                           sceneBounds.lower_z),
+                     vec3f(sceneBounds.upper_x,
+                           sceneBounds.upper_y,
+                           sceneBounds.upper_z));
+
+      primitives.clear();
+      primitives.push_back({nullptr, -1, bounds, 0,
+                            nullptr, 0, assembly.get(), nullptr});
+
+      const std::chrono::duration<double> loadTime =
+          std::chrono::steady_clock::now() - start;
+
+      std::stringstream msg;
+      msg << std::fixed << std::setprecision(3)
+          << "#osp:brlcad: '" << database->filename << "': "
+          << partNames.size() << " part(s) placed " << numInstances
+          << " time(s), " << remainders.size() << " remainder scene(s), "
+          << loadTime.count() << "s\n";
+      postStatusMsg(msg);
+    }
+
+    void BRLCAD::replicateScenes(const std::string &cacheDir,
+                                 const rt_tess_tol *proxyTol)
+    {
+      const auto start = std::chrono::steady_clock::now();
+
+      std::vector<std::vector<std::shared_ptr<Scene>>> nextReplicas;
+      std::vector<size_t> missing;
+
+      for (size_t i = 0; i < scenes.size(); ++i) {
+        auto found = std::find(replicated.begin(), replicated.end(), scenes[i]);
+        if (found != replicated.end() &&
+            replicas[found - replicated.begin()].size() == size_t(numaNodes)) {
+          nextReplicas.push_back(replicas[found - replicated.begin()]);
+        } else {
+          nextReplicas.emplace_back(numaNodes);
+          missing.push_back(i);
+        }
+      }
+
+      // the scene itself was prepped by this thread, so it serves this
+      // thread's node; every other node gets a loader bound to its CPUs so
+      // the prep (and librt's own prep threads, which inherit the binding)
+      // touches that node's memory first. The per-thread resources are
+      // allocated by the tracing threads of the node, as they first shoot.
+      // NOTE: the nodes are loaded one after the other, each by librt's
+      //       threads on that node's CPUs
+      if (!missing.empty()) {
+        const int home = currentNumaNode(numaNodes);
+
+        for (size_t i : missing)
+          nextReplicas[i][home] = scenes[i];
+
+        for (int node = 0; node < numaNodes; ++node) {
+          if (node == home)
+            continue;
+
+          runOnNumaNode(node, numaNodes, [&]() {
+            for (size_t i : missing) {
+              auto replica = std::make_shared<Scene>(database,
+                                                     scenes[i]->objects,
+                                                     cacheDir, proxyTol);
+              replica->matchRegions(*scenes[i]);
+              nextReplicas[i][node] = replica;
+            }
+          });
+        }
+      }
+
+      replicated = scenes;
+      replicas   = std::move(nextReplicas);
+
+      replicaPtrs.clear();
+      for (const auto &nodeScenes : replicas) {
+        replicaPtrs.emplace_back();
+        for (const auto &replica : nodeScenes)
+          replicaPtrs.back().push_back(replica.get());
+      }
+
+      const std::chrono::duration<double> replicateTime =
+          std::chrono::steady_clock::now() - start;
+
+      std::stringstream msg;
+      msg << std::fixed << std::setprecision(3)
+          << "#osp:brlcad: '" << database->filename << "': "
+          << missing.size() << " object(s) replicated on " << numaNodes - 1
+          << " more NUMA node(s) (of " << numaNodeCount() << "), "
+          << replicateTime.count() << "s\n";
+      postStatusMsg(msg);
+    }
+
+    void BRLCAD::startAsyncLoad(std::shared_ptr<Database> db,
+                                std::vector<std::string> nextObjects,
+                                const std::string &cacheDir,
+                                const rt_tess_tol *proxyTol)
+    {
+      // bounds come from the database directory (or already prepped scenes),
+      // which is cheap next to walking and prepping the trees
+      std::vector<box3f> objectBounds;
+      for (const auto &obj : nextObjects)
+        objectBounds.push_back(queryBounds(db->filename, {obj}));
+
+      // objects that are prepped already (say, kept from the last commit)
+      // are taken over by the load right away and traced exactly
+      asyncLoad = AsyncLoad::start(db, nextObjects, cacheDir, proxyTol);
+
+      database = db;
+      scenes.clear();
+      objects  = std::move(nextObjects);
+      assembly = nullptr;
+
+      bounds = empty;
+      primitives.clear();
+      for (size_t i = 0; i < objects.size(); ++i) {
+        bounds.extend(objectBounds[i]);
+        primitives.push_back({nullptr, -1, objectBounds[i], 0,
+                              asyncLoad.get(), uint(i), nullptr, nullptr});
+      }
+
+      postStatusMsg("#osp:brlcad: '" + database->filename + "': loading " +
+                    std::to_string(objects.size()) + " object(s) in the"
+                    " background\n");
+    }
+
     void BRLCAD::commit()
     {
-      if (rtip)
-        rt_free_rti(rtip);
+      std::lock_guard<std::mutex> commitLock(commitMutex);
 
       std::string filename = getParamString("filename");
-      std::string objects  = getParamString("objects");
+      std::string objList  = getParamString("objects");
+      std::string cacheDir = getParamString("prepCache", "");
+
+      auto objNames = ospcommon::utility::split(objList, ',');
+
+      if (objNames.empty())
+        throw std::runtime_error("BRLCAD geometry requires at least one object!");
+
+      // Hybrid mode scenes carry an Embree triangle proxy built with these
+      // tolerances, so they are part of what identifies a shared scene
+      hybrid = getParam1i("hybrid", 0);
+
+      rt_tess_tol ttol;
+      ttol.magic = RT_TESS_TOL_MAGIC;
+      ttol.abs   = getParam1f("tessAbsTol", 0.f);
+      ttol.rel   = getParam1f("tessRelTol", 0.01f);
+      ttol.norm  = getParam1f("tessNormTol", 0.f) * DEG2RAD;
+
+      const rt_tess_tol *proxyTol = hybrid ? &ttol : nullptr;
+
+      regionPrimitives = getParam1i("regionPrimitives", 0);
+      collectStats     = getParam1i("stats", 0);
+      async            = getParam1i("async", 0);
+      motionBudget     = getParam1f("motionBudget", 0.f);
+      reorderRays      = getParam1i("reorderRays", 0);
+      memoryCap        = size_t(getParam1f("memoryCap", 0.f) * 1048576.0);
+      instancing       = getParam1i("instancing", 0);
+
+      // the assembly is a single primitive, culled by Embree's instances
+      if (instancing > 0)
+        regionPrimitives = false;
+
+      clipPlanes.clear();
+      if (auto *planes = getParamData("clipPlanes")) {
+        auto *p = (const vec4f *)planes->data;
+        clipPlanes.assign(p, p + planes->numItems);
+      }
+
+      sectionBox = box3f(getParam3f("sectionBoxLower", vec3f(0.f)),
+                         getParam3f("sectionBoxUpper", vec3f(-1.f)));
+      if (sectionBox.empty())
+        sectionBox = empty;
+
+      clipping = !clipPlanes.empty() || !sectionBox.empty();
+
+      auto db = acquireDatabase(filename);
+
+      std::vector<std::string> nextObjects;
+      for (const auto &obj : objNames) {
+        if (std::find(nextObjects.begin(), nextObjects.end(), obj)
+            == nextObjects.end()) {
+          nextObjects.push_back(obj);
+        }
+      }
+
+      // Data-parallel rendering: every rank splits the list the same way and
+      // keeps only its own share, which may be empty
+      rank     = getParam1i("rank", 0);
+      numRanks = getParam1i("numRanks", 1);
+
+      if (numRanks > 1) {
+        if (rank < 0 || rank >= numRanks)
+          throw std::runtime_error("BRLCAD geometry 'rank' is out of range!");
+
+        const size_t allObjects = nextObjects.size();
+        nextObjects = rankObjects(*db, nextObjects, rank, numRanks);
+
+        std::string share;
+        for (const auto &obj : nextObjects)
+          share += (share.empty() ? "" : ",") + obj;
+
+        postStatusMsg("#osp:brlcad: rank " + std::to_string(rank) + "/" +
+                      std::to_string(numRanks) + " loads " +
+                      std::to_string(nextObjects.size()) + " of " +
+                      std::to_string(allObjects) + " object(s): " +
+                      share + "\n");
+      }
+
+      // Asynchronous mode only defers work when there is some to defer: a
+      // commit after the background load has finished (or of objects that
+      // are prepped already) takes the regular path and gets region
+      // primitives, the region table and exact bounds
+      bool loadNow = !async;
+      if (async) {
+        loadNow = true;
+        for (const auto &obj : nextObjects)
+          loadNow = loadNow && lookupScene(*db, obj, proxyTol) != nullptr;
+      }
 
-      rtip = rt_dirbuild(filename.c_str(), nullptr, 0);
+      // Instancing mode plans the parts from the combinations themselves,
+      // which is quick, and always loads them right away
+      if (instancing > 0)
+        loadInstancedScenes(db, std::move(nextObjects), cacheDir, proxyTol);
+      else if (loadNow)
+        loadScenes(db, std::move(nextObjects), cacheDir, proxyTol);
+      else
+        startAsyncLoad(db, std::move(nextObjects), cacheDir, proxyTol);
+
+      // NUMA mode only applies to the regular, fully loaded path
+      numaNodes = getParam1i("numaNodes", 0);
+      if (numaNodes > 1 && !asyncLoad && !assembly) {
+        replicateScenes(cacheDir, proxyTol);
+      } else {
+        replicated.clear();
+        replicas.clear();
+        replicaPtrs.clear();
+      }
 
-      auto objNames = ospcommon::utility::split(objects, ',');
-      for (const auto &obj : objNames)
-        rt_gettree(rtip, obj.c_str());
+      // the window has to reach from a (dilated) proxy hit to the surface
+      float proxyDilation = 0.f;
+      for (const auto &scene : scenes)
+        proxyDilation = std::max(proxyDilation, scene->proxyDilation);
+
+      refineDistance =
+          getParam1f("refineDistance",
+                     std::max({float(ttol.abs), 0.01f * length(bounds.size()),
+                               2.f * proxyDilation}));
+
+      if (hybrid) {
+        size_t failedRegions = 0;
+        for (const auto &scene : scenes)
+          failedRegions += scene->proxyMesh.failedRegions;
+
+        if (failedRegions > 0) {
+          postStatusMsg("#osp:brlcad: " + std::to_string(failedRegions) +
+                        " region(s) could not be tessellated, using their"
+                        " bounding boxes as proxies\n");
+        }
+      }
 
-      rt_prep_parallel(rtip, tasking::numTaskingThreads());
+      // One Embree primitive per scene, or per region of each scene; primIDs
+      // are the scene's reg_bit offset by the regions of the scenes before it
+      // (while loading asynchronously, the placeholders are the primitives,
+      // and in instancing mode the assembly is the only one)
+      if (!asyncLoad && !assembly) {
+        primitives.clear();
+
+        uint primBase = 0;
+        for (size_t s = 0; s < scenes.size(); ++s) {
+          const auto &scene = scenes[s];
+          const Scene *const *nodeScenes =
+              replicaPtrs.empty() ? nullptr : replicaPtrs[s].data();
+
+          if (regionPrimitives) {
+            for (size_t i = 0; i < scene->regionBounds.size(); ++i) {
+              primitives.push_back({scene.get(), int(i),
+                                    scene->regionBounds[i], primBase,
+                                    nullptr, 0, nullptr, nodeScenes});
+            }
+          } else {
+            primitives.push_back({scene.get(), -1, scene->bounds, primBase,
+                                  nullptr, 0, nullptr, nodeScenes});
+          }
+          primBase += scene->regionBounds.size();
+        }
+      }
 
-      if (rtip == nullptr)
-        throw std::runtime_error("BRLCAD geometry requires an existing rt_i!");
+      // Region table: primID -> GIFT material code and region color
+      regionMaterialIDs.clear();
+      regionColors.clear();
+      regionTable.clear();
+
+      for (const auto &scene : scenes) {
+        for (size_t i = 0; i < scene->regionBounds.size(); ++i) {
+          auto *regp = scene->rtip->Regions[i];
+          regionTable.push_back(regp);
+          if (regp == REGION_NULL) {
+            regionMaterialIDs.push_back(0);
+            regionColors.push_back(vec3f(1.f));
+            continue;
+          }
+
+          const auto &mater = regp->reg_mater;
+          regionMaterialIDs.push_back(regp->reg_gmater);
+          regionColors.push_back(mater.ma_color_valid ?
+                                 vec3f(mater.ma_color[0],
+                                       mater.ma_color[1],
+                                       mater.ma_color[2]) : vec3f(1.f));
+        }
+      }
 
-      const int nThreads = tasking::numTaskingThreads() * 2;
-      resources.resize(nThreads);
-      for (int i = 0; i <  nThreads; ++i)
-        rt_init_resource(&resources[i], i, rtip);
+      materialListData = getParamData("materialList");
+      ispcMaterialPtrs.clear();
 
-      bounds.lower.x = rtip->mdl_min[0];
-      bounds.lower.y = rtip->mdl_min[1];
-      bounds.lower.z = rtip->mdl_min[2];
-      bounds.upper.x = rtip->mdl_max[0];
-      bounds.upper.y = rtip->mdl_max[1];
-      bounds.upper.z = rtip->mdl_max[2];
+      if (materialListData) {
+        auto **materials = (Material **)materialListData->data;
+        for (size_t i = 0; i < materialListData->numItems; ++i)
+          ispcMaterialPtrs.push_back(materials[i] ? materials[i]->getIE()
+                                                  : nullptr);
+      }
+
+      ispc::BRLCAD_set(getIE(),
+                       regionMaterialIDs.size(),
+                       regionMaterialIDs.data(),
+                       (ispc::vec3f*)regionColors.data(),
+                       ispcMaterialPtrs.empty() ? nullptr
+                                                : ispcMaterialPtrs.data(),
+                       ispcMaterialPtrs.size());
+
+      setUpHitCache();
+
+      accountMemory(true);
     }
 
     void BRLCAD::finalize(Model *model)
     {
       auto scene = model->embreeSceneHandle;
 
-      geomID = rtcNewUserGeometry(scene, 1);
+      geomID = rtcNewUserGeometry(scene, primitives.size());
 
       rtcSetUserData(scene, geomID, this);
       rtcSetBoundsFunction(scene, geomID, brlcadBounds);
@@ -299,6 +2350,19 @@ namespace ospray {
       rtcSetIntersectFunction(scene, geomID,
                               (RTCIntersectFunc)&brlcadIntersect);
 
+      rtcSetOccludedFunction(scene, geomID,
+                             (RTCOccludedFunc)&brlcadOccluded);
+
+      // everything wider than a single ray goes through the stream callbacks,
+      // which reorder the whole stream before shooting any of it
+      if (reorderRays) {
+        rtcSetIntersectFunctionN(scene, geomID,
+                                 (RTCIntersectFuncN)&brlcadIntersectN);
+        rtcSetOccludedFunctionN(scene, geomID,
+                                (RTCOccludedFuncN)&brlcadOccludedN);
+        return;
+      }
+
       rtcSetIntersectFunction4(scene, geomID,
                                (RTCIntersectFunc4)&brlcadIntersectNt<4>);
 
@@ -308,17 +2372,18 @@ namespace ospray {
       rtcSetIntersectFunction16(scene, geomID,
                                 (RTCIntersectFunc16)&brlcadIntersectNt<16>);
 
-      rtcSetOccludedFunction(scene, geomID,
-                             (RTCOccludedFunc)&brlcadIntersect);
+      // packets of the ISPC target's width go to BRLCAD_intersect() instead,
+      // which hands their active lanes over already compacted
+      ispc::BRLCAD_setVaryingIntersect(scene, geomID);
 
       rtcSetOccludedFunction4(scene, geomID,
-                              (RTCOccludedFunc4)&brlcadIntersectNt<4>);
+                              (RTCOccludedFunc4)&brlcadOccludedNt<4>);
 
       rtcSetOccludedFunction8(scene, geomID,
-                              (RTCOccludedFunc8)&brlcadIntersectNt<8>);
+                              (RTCOccludedFunc8)&brlcadOccludedNt<8>);
 
       rtcSetOccludedFunction16(scene, geomID,
-                               (RTCOccludedFunc16)&brlcadIntersectNt<16>);
+                               (RTCOccludedFunc16)&brlcadOccludedNt<16>);
     }
 
     OSP_REGISTER_GEOMETRY(BRLCAD, brlcad);
@@ -16,19 +16,29 @@
 
 #pragma once
 
+#include "ospcommon/AffineSpace.h"
 #include "ospcommon/vec.h"
 #include "ospcommon/box.h"
 
+#include "ospray/common/Data.h"
 #include "ospray/geometry/Geometry.h"
 
-#undef UNUSED
-#undef _USE_MATH_DEFINES
-#include "brlcad/common.h"
-#include "brlcad/vmath.h"		/* vector math macros */
-#include "brlcad/raytrace.h"	/* librt interface definitions */
-
+#include "embree2/rtcore.h"
 #include "embree2/rtcore_ray.h"
 
+#include "../moduleAPI.h"
+
+#include "librt/AsyncLoad.h"
+#include "librt/HitCache.h"
+#include "librt/Motion.h"
+#include "librt/Scene.h"
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
 namespace ospray {
   namespace brlcad {
 
@@ -43,16 +53,218 @@ namespace ospray {
 
       void finalize(Model *model) override;
 
+      /*! Post this geometry's memory use (approximate: prepped scenes plus
+          librt's per-thread resources); if it is over 'memoryCap', trim the
+          resources first. Only posts when over the cap unless 'report'. */
+      void accountMemory(bool report);
+
+      /*! accountMemory() for every live BRLCAD geometry */
+      static void accountAllMemory(bool report);
+
+      /*! Fill 'info' with the region behind hit 'primID' of 'geometry' (an
+          OSPGeometry handle); false unless it is a live, committed BRLCAD
+          geometry with such a region that is not being committed again */
+      static bool regionInfo(const void *geometry,
+                             uint primID,
+                             ospray_brlcad_region &info);
+
+      /*! Fill 'stats' with the load timings of the scenes of 'geometry' (an
+          OSPGeometry handle); false unless it is a live BRLCAD geometry
+          that is not being committed */
+      static bool loadStats(const void *geometry,
+                            ospray_brlcad_load_stats &stats);
+
+      /*! MotionBudget::noteMotion() of every live BRLCAD geometry */
+      static void noteAllMotion();
+
+      /*! Whether any live BRLCAD geometry traced sparse frames during a
+          motion that has ended since (see MotionBudget::settled()) */
+      static bool anyMotionSettled();
+
+      struct Assembly;
+
+      /*! One Embree primitive: a whole Scene, or a single region of it */
+      struct Primitive
+      {
+        const Scene *scene;
+        int region;      /*!< reg_bit, or -1 for the whole scene */
+        box3f bounds;
+        uint primBase;   /*!< added to reg_bit to form the reported primID */
+
+        /*! With a null 'scene', the background load that will provide
+            objects[object]; 'bounds' is traced as a placeholder until then,
+            and the load numbers the object's regions (see
+            AsyncLoad::primBase()) */
+        const AsyncLoad *pending;
+        uint object;
+
+        /*! With a null 'scene', traced by instancing the parts of
+            'assembly' instead (see 'instancing') */
+        const Assembly *assembly;
+
+        /*! NUMA mode: copies of 'scene', one per node, traced instead of it
+            by the threads of that node (see 'numaNodes') */
+        const Scene *const *replicas;
+      };
+
+      /*! A Scene placed into an Assembly: one user geometry of its own
+          Embree scene, instanced once per placement */
+      struct AssemblyPiece
+      {
+        const BRLCAD *geom;
+        Primitive prim;
+        uint geomID;     /*!< in the Embree scene holding the piece */
+      };
+
+      /*! Private Embree scene of instances of the parts' scenes (each
+          prepped once) plus the remainder, traced as one model primitive */
+      struct Assembly
+      {
+        ~Assembly();
+
+        RTCScene scene {nullptr};
+        std::vector<RTCScene> partScenes;
+        std::vector<std::unique_ptr<AssemblyPiece>> pieces;
+
+        /*! Inverse transpose of each instance's placement, indexed by its
+            geomID in 'scene' (null for the remainder geometries) */
+        std::vector<std::unique_ptr<linear3f>> normalXfms;
+      };
+
       // Data members //
 
       uint geomID {0};
 
-      application ap;
-      rt_i *rtip {nullptr};
+      std::shared_ptr<Database> database;
+
+      /*! One prepped Scene per top-level object, in 'objects' order. Scenes
+          are shared process-wide (see librt/Registry.h), so a commit that
+          only adds or removes objects keeps the rest as-is */
+      std::vector<std::shared_ptr<Scene>> scenes;
 
-      mutable std::vector<resource> resources;
+      std::vector<Primitive> primitives;
 
       std::vector<std::string> objects;
+
+      /*! Asynchronous mode: commit() only queries bounds and leaves the
+          loading and prepping to a background task, tracing each object's
+          bounding box until its Scene is ready */
+      bool async {false};
+      std::shared_ptr<AsyncLoad> asyncLoad;
+
+      /*! Instancing mode: subassemblies that occur at least this many times
+          (0 disables it) are prepped once and placed by Embree instances
+          with their combination matrices */
+      int instancing {0};
+      std::unique_ptr<Assembly> assembly;
+
+      /*! Register one Embree primitive per region instead of one for the
+          whole model, so Embree's BVH culls rays before they reach librt */
+      bool regionPrimitives {false};
+
+      /*! Hybrid mode: Embree traces a tessellated proxy of each scene first
+          and librt is only asked for the exact hit within 'refineDistance'
+          of the proxy hit */
+      bool hybrid {false};
+      float refineDistance {0.f};
+
+      /*! Motion mode: while the application reports camera motion (see
+          MotionBudget), trace only as many primary rays per second
+          through librt as this (0 disables it) */
+      float motionBudget {0.f};
+      mutable MotionBudget motion;
+
+      /*! Register Embree's stream callbacks only, which buffer the valid
+          rays of each stream and shoot them sorted by direction octant and
+          Morton order of origin/direction rather than in lane order, so
+          incoherent (secondary, AO) rays walk librt's space partition
+          coherently */
+      bool reorderRays {false};
+
+      /*! Cutaway views: rays are only traced through what is left after
+          removing the half spaces in front of 'clipPlanes' (a, b, c, d with
+          ax + by + cz + d > 0 removed) and everything outside 'sectionBox'
+          (unless empty); faces cut through solid material are capped */
+      std::vector<vec4f> clipPlanes;
+      box3f sectionBox {empty};
+      bool clipping {false};
+
+      /*! NUMA mode: every scene is prepped again on each other of
+          'numaNodes' nodes, by a thread bound to it, so that its space
+          partition, solids and per-thread resources live in that node's
+          memory; rays are traced through the copy local to the tracing
+          thread. replicas[i][node] copies replicated[i] (or is
+          replicated[i] itself, on the node that committed it), and
+          replicaPtrs[i] lists replicas[i] for Primitive::replicas. */
+      int numaNodes {0};
+      std::vector<std::shared_ptr<Scene>> replicated;
+      std::vector<std::vector<std::shared_ptr<Scene>>> replicas;
+      std::vector<std::vector<const Scene*>> replicaPtrs;
+
+      /*! Data-parallel rendering: this geometry only loads the share of
+          'objects' of rank 'rank' of 'numRanks' (see librt/Partition.h) */
+      int rank {0};
+      int numRanks {1};
+
+      /*! Static camera mode: primary hits are cached per pixel footprint
+          ('hitCache' radians across) and reused by later frames; the table
+          counts against 'memoryCap' */
+      std::unique_ptr<HitCache> hitCache;
+
+      /*! 'memoryCap' parameter (given in MB; 0 for none) */
+      size_t memoryCap {0};
+
+      /*! Count rays, hits and time spent in librt (see librt/Stats.h) */
+      bool collectStats {false};
+
+      /*! Per region shading data (indexed by primID) shared with ISPC, so
+          region and material IDs come out of the same traversal as shading */
+      std::vector<int> regionMaterialIDs;
+      std::vector<vec3f> regionColors;
+
+      /*! The region behind each primID (null for unused reg_bits), for
+          regionInfo() */
+      std::vector<const region*> regionTable;
+
+      /*! Optional 'materialList', indexed by GIFT material code (reg_gmater) */
+      Ref<Data> materialListData;
+      std::vector<void*> ispcMaterialPtrs;
+
+    private:
+
+      /*! Held by commit(), so accountAllMemory() skips a changing geometry */
+      std::mutex commitMutex;
+
+      /*! 'scenes' and their replicas, each once */
+      std::set<const Scene*> distinctScenes() const;
+
+      /*! (Re)create 'hitCache' per the 'hitCache' and 'hitCacheEye'
+          parameters, with a table that fits under 'memoryCap' */
+      void setUpHitCache();
+
+      /*! Acquire the scenes of 'nextObjects' now (the regular commit) */
+      void loadScenes(std::shared_ptr<Database> db,
+                      std::vector<std::string> nextObjects,
+                      const std::string &cacheDir,
+                      const rt_tess_tol *proxyTol);
+
+      /*! Plan the instanced parts of 'nextObjects', acquire their scenes
+          and the remainders' and build 'assembly' over them */
+      void loadInstancedScenes(std::shared_ptr<Database> db,
+                               std::vector<std::string> nextObjects,
+                               const std::string &cacheDir,
+                               const rt_tess_tol *proxyTol);
+
+      /*! Replicate 'scenes' on each of 'numaNodes' nodes, keeping the
+          replicas of scenes that were replicated before */
+      void replicateScenes(const std::string &cacheDir,
+                           const rt_tess_tol *proxyTol);
+
+      /*! Start an AsyncLoad of 'nextObjects' and set up placeholders */
+      void startAsyncLoad(std::shared_ptr<Database> db,
+                          std::vector<std::string> nextObjects,
+                          const std::string &cacheDir,
+                          const rt_tess_tol *proxyTol);
     };
 
   } // ::ospray::brlcad
@@ -0,0 +1,133 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "AsyncLoad.h"
+#include "Registry.h"
+
+#include "ospray/common/OSPCommon.h"
+
+#include "ospcommon/tasking/schedule.h"
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      std::atomic<size_t> runningLoads {0};
+
+    } // ::ospray::brlcad::{anonymous}
+
+    std::shared_ptr<AsyncLoad>
+    AsyncLoad::start(std::shared_ptr<Database> database,
+                     const std::vector<std::string> &objects,
+                     const std::string &prepCacheDir,
+                     const rt_tess_tol *proxyTol)
+    {
+      std::shared_ptr<AsyncLoad> load(new AsyncLoad);
+      load->database = database;
+      load->objects  = objects;
+      load->published.reset(new std::atomic<const Scene*>[objects.size()]);
+      load->primBases.reset(new std::atomic<uint32_t>[objects.size()]);
+      load->failures.reset(new std::atomic<bool>[objects.size()]);
+
+      // objects that are prepped already (e.g. kept from the caller's last
+      // commit) are published right away, and referenced before the caller
+      // lets go of them
+      size_t toLoad = 0;
+      for (size_t i = 0; i < objects.size(); ++i) {
+        auto scene = lookupScene(*database, objects[i], proxyTol);
+        load->published[i] = nullptr;
+        load->primBases[i] = 0;
+        load->failures[i]  = false;
+        if (scene) {
+          load->scenes.push_back(scene);
+          load->publish(i, scene.get());
+        } else {
+          toLoad++;
+        }
+      }
+
+      load->remaining = toLoad;
+
+      const bool hasProxy = proxyTol != nullptr;
+      const rt_tess_tol ttol = hasProxy ? *proxyTol : rt_tess_tol();
+
+      runningLoads++;
+
+      // the task holds its own reference, so the load finishes (and its
+      // scenes stay registered for the next commit) even if the geometry
+      // that started it goes away first
+      tasking::schedule([load, prepCacheDir, hasProxy, ttol]() {
+        load->run(prepCacheDir, hasProxy ? &ttol : nullptr);
+        runningLoads--;
+      });
+
+      return load;
+    }
+
+    void AsyncLoad::run(const std::string &prepCacheDir,
+                        const rt_tess_tol *proxyTol)
+    {
+      std::vector<std::string> toLoad;
+      std::vector<size_t> index;
+      for (size_t i = 0; i < objects.size(); ++i) {
+        if (!scene(i)) {
+          toLoad.push_back(objects[i]);
+          index.push_back(i);
+        }
+      }
+
+      std::atomic<size_t> failedObjects {0};
+
+      // an object that fails is traced as nothing from then on, rather than
+      // as its placeholder
+      acquireScenes(database, toLoad, prepCacheDir, proxyTol,
+          [&](size_t i, const std::shared_ptr<Scene> &scene, bool) {
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              scenes.push_back(scene);
+            }
+            publish(index[i], scene.get());
+          },
+          [&](size_t i, const std::string &error) {
+            failures[index[i]].store(true, std::memory_order_release);
+            failedObjects++;
+            postStatusMsg("#osp:brlcad: could not load '" + toLoad[i] +
+                          "': " + error + ", leaving it out until the next"
+                          " commit\n");
+          });
+
+      remaining.store(0, std::memory_order_release);
+
+      postStatusMsg("#osp:brlcad: background load of '" + database->filename
+                    + "' finished, " + std::to_string(failedObjects) +
+                    " object(s) failed\n");
+    }
+
+    void AsyncLoad::publish(size_t i, const Scene *scene)
+    {
+      primBases[i].store(nextPrimBase.fetch_add(scene->regionBounds.size()),
+                         std::memory_order_relaxed);
+      published[i].store(scene, std::memory_order_release);
+    }
+
+    size_t pendingAsyncLoads()
+    {
+      return runningLoads;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
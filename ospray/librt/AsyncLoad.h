@@ -0,0 +1,95 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Scene.h"
+
+#include <atomic>
+#include <mutex>
+
+namespace ospray {
+  namespace brlcad {
+
+    /*! Scenes of a list of objects, acquired from the registry on a
+        background task. Each object's Scene is published on its own as soon
+        as it is prepped, so a geometry can trace the objects that are done
+        and a placeholder for the rest while the load is under way. */
+    struct AsyncLoad
+    {
+      /*! Start loading; 'proxyTol' is copied (see acquireScene()) */
+      static std::shared_ptr<AsyncLoad>
+      start(std::shared_ptr<Database> database,
+            const std::vector<std::string> &objects,
+            const std::string &prepCacheDir,
+            const rt_tess_tol *proxyTol);
+
+      /*! The Scene of objects[i], or null while it is still loading (or if
+          it failed to load) */
+      inline const Scene *scene(size_t i) const
+      {
+        return published[i].load(std::memory_order_acquire);
+      }
+
+      /*! objects[i] could not be loaded: there is nothing to trace for it,
+          and the registry will try it again when it is next asked for */
+      inline bool failed(size_t i) const
+      {
+        return failures[i].load(std::memory_order_acquire);
+      }
+
+      /*! Offset of objects[i]'s regions in the primIDs of the load: objects
+          are numbered in the order they become ready, so their regions do
+          not overlap. Only meaningful once scene(i) is non-null. */
+      inline uint32_t primBase(size_t i) const
+      {
+        return primBases[i].load(std::memory_order_relaxed);
+      }
+
+      /*! Every object has been attempted */
+      inline bool done() const
+      {
+        return remaining.load(std::memory_order_acquire) == 0;
+      }
+
+      std::shared_ptr<Database> database;
+      std::vector<std::string> objects;
+
+    private:
+
+      AsyncLoad() = default;
+
+      void run(const std::string &prepCacheDir, const rt_tess_tol *proxyTol);
+
+      /*! Publish 'scene' as objects[i], numbering its regions after those
+          of the objects published before it */
+      void publish(size_t i, const Scene *scene);
+
+      std::unique_ptr<std::atomic<const Scene*>[]> published;
+      std::unique_ptr<std::atomic<uint32_t>[]> primBases;
+      std::unique_ptr<std::atomic<bool>[]> failures;
+      std::atomic<uint32_t> nextPrimBase {0};
+      std::atomic<size_t> remaining {0};
+
+      std::mutex mutex;
+      std::vector<std::shared_ptr<Scene>> scenes;
+    };
+
+    /*! Number of AsyncLoads still running, process-wide */
+    size_t pendingAsyncLoads();
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,187 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Batch.h"
+
+#include "ospcommon/tasking/parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      struct BatchHit
+      {
+        unsigned int region;
+        float inDist, outDist;
+        float inObliquity, outObliquity;
+      };
+
+      struct BatchState
+      {
+        std::vector<BatchHit> *hits;
+        unsigned int primBase;
+      };
+
+      float obliquity(const vect_t normal, const vect_t dir)
+      {
+        const double c = std::min(1.0, std::fabs(VDOT(normal, dir)));
+        return float(std::acos(c));
+      }
+
+      int batchHitCallback(application *ap, partition *PartHeadp, seg *segs)
+      {
+        auto &state = *static_cast<BatchState*>(ap->a_uptr);
+
+        for (auto *pp = PartHeadp->pt_forw; pp != PartHeadp; pp = pp->pt_forw) {
+          vect_t inormal, onormal;
+          RT_HIT_NORMAL(inormal, pp->pt_inhit, pp->pt_inseg->seg_stp,
+                        &(ap->a_ray), pp->pt_inflip);
+          RT_HIT_NORMAL(onormal, pp->pt_outhit, pp->pt_outseg->seg_stp,
+                        &(ap->a_ray), pp->pt_outflip);
+
+          BatchHit hit;
+          hit.region       = state.primBase + pp->pt_regionp->reg_bit;
+          hit.inDist       = pp->pt_inhit->hit_dist;
+          hit.outDist      = pp->pt_outhit->hit_dist;
+          hit.inObliquity  = obliquity(inormal, ap->a_ray.r_dir);
+          hit.outObliquity = obliquity(onormal, ap->a_ray.r_dir);
+          state.hits->push_back(hit);
+        }
+
+        return 1;
+      }
+
+      int batchMissCallback(application *ap)
+      {
+        return 0;
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    int shootBatch(const std::vector<std::shared_ptr<Scene>> &scenes,
+                   const ospray_brlcad_batch_rays &rays,
+                   ospray_brlcad_batch_hits &hits)
+    {
+      static constexpr size_t BLOCK_SIZE = 64;
+
+      std::atomic<size_t> used {0};
+      std::atomic<size_t> dropped {0};
+
+      const size_t numBlocks = (rays.count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+      tasking::parallel_for(numBlocks, [&](size_t block) {
+        // reused across blocks and calls, so steady state shooting does no
+        // per-hit (or per-block) heap allocation
+        static thread_local std::vector<BatchHit> rayHits;
+        static thread_local std::vector<application> aps;
+
+        BatchState state;
+        state.hits = &rayHits;
+
+        aps.resize(scenes.size());
+        for (size_t s = 0; s < scenes.size(); ++s) {
+          auto &ap = aps[s];
+          RT_APPLICATION_INIT(&ap);
+          ap.a_rt_i       = scenes[s]->rtip;
+          ap.a_onehit     = 0;
+          ap.a_resource   = scenes[s]->resources.local();
+          ap.a_hit        = batchHitCallback;
+          ap.a_miss       = batchMissCallback;
+          ap.a_logoverlap = rt_silent_logoverlap;
+          ap.a_uptr       = &state;
+        }
+
+        const size_t begin = block * BLOCK_SIZE;
+        const size_t end   = std::min(begin + BLOCK_SIZE, rays.count);
+
+        for (size_t i = begin; i < end; ++i) {
+          rayHits.clear();
+
+          unsigned int primBase = 0;
+          for (size_t s = 0; s < scenes.size(); ++s) {
+            auto &ap = aps[s];
+            VSET(ap.a_ray.r_pt, rays.orgx[i], rays.orgy[i], rays.orgz[i]);
+            VSET(ap.a_ray.r_dir, rays.dirx[i], rays.diry[i], rays.dirz[i]);
+            ap.a_ray.r_min = rays.tnear ? rays.tnear[i] : 0.f;
+            ap.a_ray.r_max = rays.tfar ? rays.tfar[i]
+                                       : std::numeric_limits<float>::infinity();
+
+            state.primBase = primBase;
+            rt_shootray(&ap);
+
+            primBase += scenes[s]->rtip->nregions;
+          }
+
+          // separate objects come back one after the other
+          if (scenes.size() > 1) {
+            std::sort(rayHits.begin(), rayHits.end(),
+                      [](const BatchHit &a, const BatchHit &b) {
+                        return a.inDist < b.inDist;
+                      });
+          }
+
+          // a range is only claimed if it fits, so 'used' never runs past
+          // what is written and later, smaller rays can still fit
+          const size_t n = rayHits.size();
+          size_t first = n ? used.load(std::memory_order_relaxed) : 0;
+          bool fits = true;
+
+          while (n) {
+            if (first + n > hits.capacity) {
+              fits = false;
+              break;
+            }
+            if (used.compare_exchange_weak(first, first + n,
+                                           std::memory_order_relaxed)) {
+              break;
+            }
+          }
+
+          if (!fits) {
+            dropped++;
+            hits.first[i]   = 0;
+            hits.numHits[i] = 0;
+            continue;
+          }
+
+          hits.first[i]   = first;
+          hits.numHits[i] = n;
+
+          for (size_t h = 0; h < n; ++h) {
+            const auto &hit = rayHits[h];
+            hits.region[first + h]       = hit.region;
+            hits.inDist[first + h]       = hit.inDist;
+            hits.outDist[first + h]      = hit.outDist;
+            hits.inObliquity[first + h]  = hit.inObliquity;
+            hits.outObliquity[first + h] = hit.outObliquity;
+          }
+        }
+      });
+
+      hits.dropped = dropped;
+      hits.used    = used;
+
+      return hits.dropped ? 2 : 0;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
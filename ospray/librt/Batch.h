@@ -0,0 +1,33 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Scene.h"
+
+#include "../moduleAPI.h"
+
+namespace ospray {
+  namespace brlcad {
+
+    /*! Shoot every ray of 'rays' at 'scenes' (in primID order) with all
+        partitions recorded into 'hits'; see ospray_brlcad_shoot_batch() */
+    int shootBatch(const std::vector<std::shared_ptr<Scene>> &scenes,
+                   const ospray_brlcad_batch_rays &rays,
+                   ospray_brlcad_batch_hits &hits);
+
+  } // ::ospray::brlcad
+} // ::ospray
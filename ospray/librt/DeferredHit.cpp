@@ -0,0 +1,143 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "DeferredHit.h"
+#include "ResourcePool.h"
+
+#include <atomic>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      constexpr uint32_t ARENA_SIZE = 4096;
+
+      struct ArenaEntry
+      {
+        uint32_t seq {0};
+        DeferredHit hit;
+      };
+
+      struct Arena
+      {
+        uint32_t next {1};
+        ArenaEntry entries[ARENA_SIZE];
+      };
+
+      // NOTE: arenas belong to thread slots, which are reused after their
+      //       thread exits, so they are kept for the life of the process
+      std::atomic<Arena*> arenas[ResourcePool::MAX_SLOTS];
+
+      Arena &localArena(int slot)
+      {
+        auto *arena = arenas[slot].load(std::memory_order_acquire);
+        if (arena == nullptr) {
+          arena = new Arena;
+          arenas[slot].store(arena, std::memory_order_release);
+        }
+        return *arena;
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    // DeferredHit definitions ////////////////////////////////////////////////
+
+    void DeferredHit::record(soltab *_stp,
+                             const hit *hitp,
+                             const xray &_ray,
+                             bool _flip)
+    {
+      stp       = _stp;
+      hitData   = *hitp;
+      ray       = _ray;
+      flip      = _flip;
+      evaluated = false;
+
+      if (stp->st_id == ID_NMG)
+        evaluate();
+    }
+
+    void DeferredHit::recordNormal(const vec3f &knownNormal)
+    {
+      stp       = nullptr;
+      flip      = false;
+      normal    = knownNormal;
+      evaluated = true;
+    }
+
+    vec3f DeferredHit::evaluate()
+    {
+      if (!evaluated) {
+        hitData.hit_rayp = &ray;
+
+        vect_t n;
+        RT_HIT_NORMAL(n, &hitData, stp, &ray, flip);
+
+        normal    = vec3f(n[0], n[1], n[2]);
+        evaluated = true;
+      }
+
+      return normal;
+    }
+
+    DeferredHitHandle deferHit(const DeferredHit &hit)
+    {
+      const int slot = threadSlot();
+      auto &arena = localArena(slot);
+
+      const uint32_t seq = arena.next++;
+      auto &entry = arena.entries[seq % ARENA_SIZE];
+      entry.seq = seq;
+      entry.hit = hit;
+      entry.hit.normalXfm = nullptr;
+
+      return {slot, seq};
+    }
+
+    void setDeferredHitTransform(const DeferredHitHandle &handle,
+                                 const linear3f *normalXfm)
+    {
+      if (handle.slot != threadSlot())
+        return;
+
+      auto &entry = localArena(handle.slot).entries[handle.seq % ARENA_SIZE];
+      if (entry.seq == handle.seq)
+        entry.hit.normalXfm = normalXfm;
+    }
+
+    bool evaluateDeferredHit(const DeferredHitHandle &handle, vec3f &normal)
+    {
+      if (handle.slot < 0 || handle.slot >= ResourcePool::MAX_SLOTS)
+        return false;
+
+      auto *arena = arenas[handle.slot].load(std::memory_order_acquire);
+      if (arena == nullptr)
+        return false;
+
+      auto &entry = arena->entries[handle.seq % ARENA_SIZE];
+      if (entry.seq != handle.seq)
+        return false;
+
+      normal = entry.hit.evaluate();
+      // known normals (caps, cached hits) are in world space already
+      if (entry.hit.normalXfm && entry.hit.stp)
+        normal = normalize(xfmVector(*entry.hit.normalXfm, normal));
+      return true;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,89 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "ospcommon/AffineSpace.h"
+#include "ospcommon/vec.h"
+
+#include <cstdint>
+
+#undef UNUSED
+#undef _USE_MATH_DEFINES
+#include "brlcad/common.h"
+#include "brlcad/vmath.h"		/* vector math macros */
+#include "brlcad/raytrace.h"	/* librt interface definitions */
+
+namespace ospray {
+  namespace brlcad {
+
+    using namespace ospcommon;
+
+    /*! Everything needed to evaluate the surface normal of a librt hit
+        after rt_shootray() has returned: the solid, a copy of its hit
+        record and of the ray it refers to (ft_norm() reads hit_rayp), and
+        the partition's flip flag.
+
+        Solids whose hit records point into per-ray memory that librt frees
+        with the partition list (NMG's hitmiss structs) are evaluated right
+        away and carry their normal instead. */
+    struct DeferredHit
+    {
+      soltab *stp {nullptr};
+      hit     hitData;
+      xray    ray;
+      bool    flip {false};
+
+      bool    evaluated {false};
+      vec3f   normal;
+
+      /*! Takes the normal out of an instanced part's space, if not null */
+      const linear3f *normalXfm {nullptr};
+
+      /*! Record 'hitp' on 'stp' for later evaluation */
+      void record(soltab *stp, const hit *hitp, const xray &ray, bool flip);
+
+      /*! Record a hit whose (world space) normal is known already: a face
+          cut by a clip plane or the section box, or a cached primary hit */
+      void recordNormal(const vec3f &knownNormal);
+
+      /*! The (flipped) surface normal, evaluating it now if needed */
+      vec3f evaluate();
+    };
+
+    /*! Handle of a hit parked in the calling thread's arena; stored in the
+        Embree ray's u/v so postIntersect can find it again */
+    struct DeferredHitHandle
+    {
+      int32_t  slot;
+      uint32_t seq;
+    };
+
+    /*! Park 'hit' in the calling thread's arena. The arena is a ring, so a
+        handle stays valid for the next ARENA_SIZE hits of that thread. */
+    DeferredHitHandle deferHit(const DeferredHit &hit);
+
+    /*! Have the normal of a parked hit (of the calling thread) transformed
+        by 'normalXfm' when it is evaluated */
+    void setDeferredHitTransform(const DeferredHitHandle &handle,
+                                 const linear3f *normalXfm);
+
+    /*! Evaluate the normal of a parked hit. Returns false (and leaves
+        'normal' alone) if the handle's entry has already been reused. */
+    bool evaluateDeferredHit(const DeferredHitHandle &handle, vec3f &normal);
+
+  } // ::ospray::brlcad
+} // ::ospray
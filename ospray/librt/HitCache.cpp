@@ -0,0 +1,209 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "HitCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      inline uint64_t mix64(uint64_t x)
+      {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
+      }
+
+      inline uint32_t floatBits(float f)
+      {
+        uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        return u;
+      }
+
+      inline float bitsToFloat(uint32_t u)
+      {
+        float f;
+        std::memcpy(&f, &u, sizeof(f));
+        return f;
+      }
+
+      inline uint32_t quantizeSnorm16(float f)
+      {
+        f = std::min(1.f, std::max(-1.f, f));
+        return uint32_t(std::lround((f * .5f + .5f) * 65535.f));
+      }
+
+      inline float unquantizeSnorm16(uint32_t q)
+      {
+        return float(q) / 65535.f * 2.f - 1.f;
+      }
+
+      /*! Unit vector in 32 bits (octahedral mapping) */
+      uint32_t encodeNormal(const vec3f &n)
+      {
+        const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        float u = l1 > 0.f ? n.x / l1 : 0.f;
+        float v = l1 > 0.f ? n.y / l1 : 0.f;
+
+        if (n.z < 0.f) {
+          const float fu = (1.f - std::abs(v)) * (u < 0.f ? -1.f : 1.f);
+          const float fv = (1.f - std::abs(u)) * (v < 0.f ? -1.f : 1.f);
+          u = fu;
+          v = fv;
+        }
+
+        return quantizeSnorm16(u) << 16 | quantizeSnorm16(v);
+      }
+
+      vec3f decodeNormal(uint32_t bits)
+      {
+        const float u = unquantizeSnorm16(bits >> 16);
+        const float v = unquantizeSnorm16(bits & 0xffff);
+
+        vec3f n(u, v, 1.f - std::abs(u) - std::abs(v));
+        if (n.z < 0.f) {
+          n.x = (1.f - std::abs(v)) * (u < 0.f ? -1.f : 1.f);
+          n.y = (1.f - std::abs(u)) * (v < 0.f ? -1.f : 1.f);
+        }
+
+        return normalize(n);
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    // HitCache definitions ///////////////////////////////////////////////////
+
+    constexpr int HitCache::MAX_LOG2_SIZE;
+    constexpr int HitCache::MIN_LOG2_SIZE;
+
+    HitCache::HitCache(float footprint, int log2Size)
+      : footprint(footprint),
+        log2Size(log2Size),
+        entries(new Entry[size_t(1) << log2Size]),
+        mask((uint64_t(1) << log2Size) - 1)
+    {
+    }
+
+    size_t HitCache::bytesFor(int log2Size)
+    {
+      return (size_t(1) << log2Size) * sizeof(Entry);
+    }
+
+    size_t HitCache::bytes() const
+    {
+      return bytesFor(log2Size);
+    }
+
+    void HitCache::invalidate(const vec3f &_eye)
+    {
+      eye = _eye;
+      generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    bool HitCache::holds(const vec3f &origin) const
+    {
+      return origin.x == eye.x && origin.y == eye.y && origin.z == eye.z;
+    }
+
+    uint64_t HitCache::currentGeneration() const
+    {
+      return generation.load(std::memory_order_acquire);
+    }
+
+    uint64_t HitCache::keyOf(uint64_t gen,
+                             uint32_t item,
+                             const vec3f &dir) const
+    {
+      // cube map cell: the major axis picks the face, and the other two
+      // components over it (about the angle, near the face's center) are
+      // cut into footprints
+      const vec3f a(std::abs(dir.x), std::abs(dir.y), std::abs(dir.z));
+      const int major = a.x >= a.y ? (a.x >= a.z ? 0 : 2)
+                                   : (a.y >= a.z ? 1 : 2);
+      const float m = dir[major];
+
+      const float u = dir[(major + 1) % 3] / std::abs(m);
+      const float v = dir[(major + 2) % 3] / std::abs(m);
+
+      const uint64_t face = major * 2 + (m < 0.f ? 1 : 0);
+      const uint64_t cu = uint64_t(int64_t(std::floor(u / footprint)))
+                          & 0xfffffff;
+      const uint64_t cv = uint64_t(int64_t(std::floor(v / footprint)))
+                          & 0xfffffff;
+
+      const uint64_t cell = face | cu << 3 | cv << 31;
+
+      const uint64_t key = mix64(cell ^ mix64(gen << 32 | item));
+      return key ? key : 1;
+    }
+
+    bool HitCache::lookup(uint64_t gen,
+                          uint32_t item,
+                          const vec3f &dir,
+                          CachedHit &hit) const
+    {
+      const uint64_t key = keyOf(gen, item, dir);
+      const auto &entry = entries[key & mask];
+
+      if (entry.key.load(std::memory_order_acquire) != key)
+        return false;
+
+      const auto tAndNormal = entry.tAndNormal.load(std::memory_order_relaxed);
+      const auto primAndHit = entry.primAndHit.load(std::memory_order_relaxed);
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (entry.key.load(std::memory_order_relaxed) != key)
+        return false;
+
+      hit.hit    = primAndHit & 1;
+      hit.primID = uint32_t(primAndHit >> 32);
+      hit.t      = bitsToFloat(uint32_t(tAndNormal >> 32));
+      hit.normal = decodeNormal(uint32_t(tAndNormal));
+      return true;
+    }
+
+    void HitCache::store(uint64_t gen,
+                         uint32_t item,
+                         const vec3f &dir,
+                         const CachedHit &hit)
+    {
+      const uint64_t key = keyOf(gen, item, dir);
+      auto &entry = entries[key & mask];
+
+      entry.key.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      entry.tAndNormal.store(uint64_t(floatBits(hit.t)) << 32
+                             | encodeNormal(hit.normal),
+                             std::memory_order_relaxed);
+      entry.primAndHit.store(uint64_t(hit.primID) << 32 | (hit.hit ? 1 : 0),
+                             std::memory_order_relaxed);
+
+      entry.key.store(key, std::memory_order_release);
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,122 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "ospcommon/vec.h"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace ospray {
+  namespace brlcad {
+
+    using namespace ospcommon;
+
+    // Primary hit reuse for a static camera //////////////////////////////////
+
+    // NOTE: while an image accumulates, the primary rays of every frame
+    //       start at the same eye point and only jitter inside their pixel,
+    //       so the first hit of each pixel footprint (quantized direction
+    //       from the eye) is kept and handed out again instead of re-shooting
+    //       it. The eye is set by the application (and changing it starts
+    //       over); rays from anywhere else do not use the cache at all.
+    //       Turning the camera in place keeps what was cached, as it stays
+    //       valid.
+
+    /*! What the cache remembers of a primary ray */
+    struct CachedHit
+    {
+      bool  hit {false};
+      float t {0.f};
+      vec3f normal;
+      uint32_t primID {0};
+    };
+
+    class HitCache
+    {
+    public:
+
+      /*! Table sizes a memory cap may choose from */
+      static constexpr int MAX_LOG2_SIZE = 20;
+      static constexpr int MIN_LOG2_SIZE = 12;
+
+      /*! Cache footprints of 'footprint' radians across in a direct mapped
+          table of 2^'log2Size' entries */
+      explicit HitCache(float footprint, int log2Size = MAX_LOG2_SIZE);
+
+      /*! Memory of a table of 2^'log2Size' entries */
+      static size_t bytesFor(int log2Size);
+
+      /*! Memory of this cache's table */
+      size_t bytes() const;
+
+      /*! Forget everything (the geometry was committed) and hold hits of
+          rays from 'eye' from now on; not to be called while tracing */
+      void invalidate(const vec3f &eye);
+
+      /*! Whether rays from 'origin' are the ones the cache holds hits of */
+      bool holds(const vec3f &origin) const;
+
+      /*! The generation to look up and store with */
+      uint64_t currentGeneration() const;
+
+      /*! The cached result for the footprint of 'dir' on Embree primitive
+          'item', if any */
+      bool lookup(uint64_t generation,
+                  uint32_t item,
+                  const vec3f &dir,
+                  CachedHit &hit) const;
+
+      void store(uint64_t generation,
+                 uint32_t item,
+                 const vec3f &dir,
+                 const CachedHit &hit);
+
+      const float footprint;
+      const int log2Size;
+
+    private:
+
+      // NOTE: entries are written key last (after clearing it) and read key
+      //       first and last, so a reader only ever sees the payload of its
+      //       own footprint, if from either of two racing writers
+
+      struct Entry
+      {
+        std::atomic<uint64_t> key {0};
+        std::atomic<uint64_t> tAndNormal {0};
+        std::atomic<uint64_t> primAndHit {0};
+      };
+
+      uint64_t keyOf(uint64_t generation,
+                     uint32_t item,
+                     const vec3f &dir) const;
+
+      std::unique_ptr<Entry[]> entries;
+      const uint64_t mask;
+
+      std::atomic<uint64_t> generation {1};
+
+      /*! No ray starts at NaN, so the cache is unused until given an eye */
+      vec3f eye {std::numeric_limits<float>::quiet_NaN()};
+    };
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,200 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Instancing.h"
+
+#include <map>
+#include <stdexcept>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      /*! One member of a union combination, and the matrix on its arc */
+      struct Member
+      {
+        std::string name;
+        mat_t mat;
+      };
+
+      struct Members
+      {
+        bool unionOnly {true};
+        std::vector<Member> members;
+      };
+
+      bool collectUnion(const union tree *tp, std::vector<Member> &members)
+      {
+        if (tp == nullptr)
+          return true;
+
+        switch (tp->tr_op) {
+        case OP_DB_LEAF: {
+          Member member;
+          member.name = tp->tr_l.tl_name;
+          if (tp->tr_l.tl_mat)
+            MAT_COPY(member.mat, tp->tr_l.tl_mat);
+          else
+            MAT_IDN(member.mat);
+          members.push_back(member);
+          return true;
+        }
+        case OP_UNION:
+          return collectUnion(tp->tr_b.tb_left, members) &&
+                 collectUnion(tp->tr_b.tb_right, members);
+        default:
+          return false;
+        }
+      }
+
+      /*! Reads each combination once, however often it is referenced */
+      struct Walker
+      {
+        db_i *dbip;
+        std::map<std::string, Members> cache;
+        std::map<std::string, size_t> occurrences;
+
+        const Members &members(directory *dp)
+        {
+          auto found = cache.find(dp->d_namep);
+          if (found != cache.end())
+            return found->second;
+
+          auto &entry = cache[dp->d_namep];
+
+          // rt_uniresource is librt's, so the read is held against it
+          std::lock_guard<std::mutex> lock(librtMutex());
+
+          rt_db_internal intern;
+          if (rt_db_get_internal(&intern, dp, dbip, nullptr,
+                                 &rt_uniresource) < 0) {
+            throw std::runtime_error(std::string("BRLCAD: could not read '")
+                                     + dp->d_namep + "'");
+          }
+
+          auto *comb = static_cast<rt_comb_internal*>(intern.idb_ptr);
+          entry.unionOnly = collectUnion(comb->tree, entry.members);
+          rt_db_free_internal(&intern);
+
+          return entry;
+        }
+
+        /*! Combinations at or above region level, and their members */
+        bool splittable(directory *dp)
+        {
+          return (dp->d_flags & RT_DIR_COMB) &&
+                 !(dp->d_flags & RT_DIR_REGION) &&
+                 members(dp).unionOnly;
+        }
+
+        void count(directory *dp)
+        {
+          if (!(dp->d_flags & RT_DIR_COMB))
+            return;
+
+          occurrences[dp->d_namep]++;
+
+          if (!splittable(dp))
+            return;
+
+          for (const auto &member : members(dp).members) {
+            auto *child = db_lookup(dbip, member.name.c_str(), LOOKUP_QUIET);
+            if (child != RT_DIR_NULL)
+              count(child);
+          }
+        }
+      };
+
+      affine3f toAffine(const mat_t m)
+      {
+        // librt matrices transform column vectors, with m[15] holding the
+        // reciprocal of a global scale
+        const float s = m[15] != 0.0 ? 1.f / m[15] : 1.f;
+        return affine3f(linear3f(vec3f(m[0], m[4], m[8]) * s,
+                                 vec3f(m[1], m[5], m[9]) * s,
+                                 vec3f(m[2], m[6], m[10]) * s),
+                        vec3f(m[3], m[7], m[11]) * s);
+      }
+
+      struct Placer
+      {
+        Walker &walker;
+        size_t minOccurrences;
+        InstancePlan &plan;
+        std::map<std::string, size_t> partIndex;
+
+        void place(directory *dp, const std::string &path, const mat_t mat,
+                   bool top)
+        {
+          const bool isComb = dp->d_flags & RT_DIR_COMB;
+
+          if (isComb && !top &&
+              walker.occurrences[dp->d_namep] >= minOccurrences) {
+            auto found = partIndex.find(dp->d_namep);
+            if (found == partIndex.end()) {
+              found = partIndex.emplace(dp->d_namep, plan.parts.size()).first;
+              plan.parts.push_back({dp->d_namep, {}});
+            }
+            plan.parts[found->second].placements.push_back(toAffine(mat));
+            return;
+          }
+
+          if (!walker.splittable(dp)) {
+            plan.remainder.push_back(path);
+            return;
+          }
+
+          for (const auto &member : walker.members(dp).members) {
+            auto *child = db_lookup(walker.dbip, member.name.c_str(),
+                                    LOOKUP_QUIET);
+            if (child == RT_DIR_NULL)
+              continue;
+
+            mat_t childMat;
+            bn_mat_mul(childMat, mat, member.mat);
+            place(child, path + "/" + member.name, childMat, false);
+          }
+        }
+      };
+
+    } // ::ospray::brlcad::{anonymous}
+
+    InstancePlan planInstances(const Database &database,
+                               const std::string &object,
+                               int minOccurrences)
+    {
+      auto *dp = db_lookup(database.dbip, object.c_str(), LOOKUP_QUIET);
+      if (dp == RT_DIR_NULL)
+        throw std::runtime_error("BRLCAD: no object '" + object + "' in "
+                                 + database.filename);
+
+      Walker walker {database.dbip};
+      walker.count(dp);
+
+      InstancePlan plan;
+
+      Placer placer {walker, size_t(std::max(2, minOccurrences)), plan};
+
+      mat_t identity;
+      MAT_IDN(identity);
+      placer.place(dp, object, identity, true);
+
+      return plan;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,53 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Scene.h"
+
+#include "ospcommon/AffineSpace.h"
+
+namespace ospray {
+  namespace brlcad {
+
+    /*! How a top-level object splits into subassemblies that are prepped
+        once and placed many times, and whatever is left over */
+    struct InstancePlan
+    {
+      struct Part
+      {
+        std::string name;                 //!< combination prepped on its own
+        std::vector<affine3f> placements; //!< one per occurrence
+      };
+
+      std::vector<Part> parts;
+
+      /*! Full paths ("top/assy/part.r") of the regions (and loose solids)
+          outside every part, for rt_gettrees(), which applies the matrices
+          along each path itself */
+      std::vector<std::string> remainder;
+    };
+
+    /*! Walk the combinations above the regions of 'object' and make every
+        one that occurs at least 'minOccurrences' times a part, placed with
+        the product of the matrices along each path to it. Combinations with
+        booleans other than union stay whole, as librt would see them. */
+    InstancePlan planInstances(const Database &database,
+                               const std::string &object,
+                               int minOccurrences);
+
+  } // ::ospray::brlcad
+} // ::ospray
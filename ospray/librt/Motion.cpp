@@ -0,0 +1,123 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Motion.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      using Clock = std::chrono::steady_clock;
+
+      /*! How long after the last change rendering still counts as moving */
+      constexpr int64_t MOTION_HOLD_NS = 150000000;
+
+      /*! Length of the window the ray rate is measured over */
+      constexpr int64_t BUDGET_WINDOW_NS = 100000000;
+
+      constexpr int MAX_STRIDE = 16;
+
+      /*! Rays a thread tallies before adding them to the shared count */
+      constexpr uint64_t FLUSH_RAYS = 1024;
+
+      /*! This thread's rays not yet added to 'owner's count */
+      struct RayTally
+      {
+        const MotionBudget *owner {nullptr};
+        uint64_t rays {0};
+      };
+
+      thread_local RayTally tally;
+
+      inline int64_t nowNs()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now().time_since_epoch()).count();
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    void MotionBudget::noteMotion()
+    {
+      lastMotionNs.store(nowNs(), std::memory_order_relaxed);
+    }
+
+    bool MotionBudget::inMotion() const
+    {
+      return nowNs() - lastMotionNs.load(std::memory_order_relaxed)
+             < MOTION_HOLD_NS;
+    }
+
+    int MotionBudget::stride(float raysPerSecond)
+    {
+      const int64_t now = nowNs();
+
+      if (now - lastMotionNs.load(std::memory_order_relaxed) >= MOTION_HOLD_NS)
+        return 1;
+
+      // one thread per window closes it and adapts the stride: halve the
+      // traced rays while over budget, double them while well under it
+      int64_t start = windowStartNs.load(std::memory_order_relaxed);
+      if (now - start >= BUDGET_WINDOW_NS &&
+          windowStartNs.compare_exchange_strong(start, now)) {
+        const double seconds = (now - start) * 1e-9;
+        const double rate    = windowRays.exchange(0) / seconds;
+
+        int s = currentStride.load(std::memory_order_relaxed);
+        if (rate > raysPerSecond)
+          s = std::min(MAX_STRIDE, s * 2);
+        else if (rate * 2.0 < raysPerSecond)
+          s = std::max(1, s / 2);
+        currentStride.store(s, std::memory_order_relaxed);
+      }
+
+      const int s = currentStride.load(std::memory_order_relaxed);
+
+      if (s > 1 && !sparse.load(std::memory_order_relaxed))
+        sparse.store(true, std::memory_order_relaxed);
+
+      return s;
+    }
+
+    void MotionBudget::countRays(uint64_t n)
+    {
+      // a tally left over from another geometry is dropped rather than
+      // flushed, since that geometry may be gone by now
+      if (tally.owner != this) {
+        tally.owner = this;
+        tally.rays  = 0;
+      }
+
+      tally.rays += n;
+      if (tally.rays >= FLUSH_RAYS) {
+        windowRays.fetch_add(tally.rays, std::memory_order_relaxed);
+        tally.rays = 0;
+      }
+    }
+
+    bool MotionBudget::settled()
+    {
+      return !inMotion() && sparse.load(std::memory_order_relaxed) &&
+             sparse.exchange(false);
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,71 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace ospray {
+  namespace brlcad {
+
+    // Interactive motion ray budget //////////////////////////////////////////
+
+    // NOTE: the application reports camera changes through noteMotion(); for
+    //       a short while after each one, a geometry with a motion budget
+    //       traces only a stratified subset of each primary ray packet
+    //       through librt and fills in the rest from the neighbours. Each
+    //       geometry adapts its own stride; rays are tallied per thread and
+    //       only added to the shared count every FLUSH_RAYS rays.
+
+    /*! Motion state and ray budget of one geometry */
+    class MotionBudget
+    {
+    public:
+
+      /*! The camera (or anything else invalidating the image) just changed */
+      void noteMotion();
+
+      /*! Whether the last noteMotion() is recent enough to still count as
+          moving; rendering converges back to full resolution after that */
+      bool inMotion() const;
+
+      /*! Every how many primary rays one is traced while moving, adapted so
+          that the librt rays reported by countRays() stay close to
+          'raysPerSecond'. Returns 1 when not moving, or when moving but
+          tracing every ray stays within the budget. */
+      int stride(float raysPerSecond);
+
+      /*! Report 'n' rays traced through librt under the budget */
+      void countRays(uint64_t n);
+
+      /*! True once after motion ended if sparse frames were traced since,
+          so the application can drop them from its accumulation buffer */
+      bool settled();
+
+    private:
+
+      std::atomic<int64_t> lastMotionNs {INT64_MIN / 2};
+
+      std::atomic<int64_t>  windowStartNs {0};
+      std::atomic<uint64_t> windowRays {0};
+      std::atomic<int>      currentStride {4};
+
+      std::atomic<bool> sparse {false};
+    };
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,155 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Numa.h"
+
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      int cpuCount()
+      {
+        const int n = std::thread::hardware_concurrency();
+        return n > 0 ? n : 1;
+      }
+
+      /*! CPUs listed in a sysfs cpulist ("0-7,16-23") */
+      std::vector<int> readCpuList(const std::string &path)
+      {
+        std::vector<int> cpus;
+
+        std::ifstream in(path);
+        std::string range;
+        while (std::getline(in, range, ',')) {
+          int first = 0, last = 0;
+          char dash = 0;
+          std::istringstream fields(range);
+          if (!(fields >> first))
+            continue;
+          if (!(fields >> dash >> last))
+            last = first;
+          for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+        }
+
+        return cpus;
+      }
+
+      std::string nodeCpuListPath(int node)
+      {
+        return "/sys/devices/system/node/node" + std::to_string(node)
+               + "/cpulist";
+      }
+
+      /*! Node of 'cpu', following the machine's topology if it has 'nodes'
+          nodes and splitting the CPUs evenly otherwise */
+      int nodeOfCpu(int cpu, int nodes)
+      {
+        if (nodes <= 1)
+          return 0;
+
+        if (nodes == numaNodeCount()) {
+          for (int node = 0; node < nodes; ++node) {
+            for (int c : readCpuList(nodeCpuListPath(node))) {
+              if (c == cpu)
+                return node;
+            }
+          }
+        }
+
+        return (cpu % cpuCount()) * nodes / cpuCount();
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    int numaNodeCount()
+    {
+      static const int count = []() {
+        int nodes = 0;
+        while (std::ifstream(nodeCpuListPath(nodes)).good())
+          nodes++;
+        return nodes > 0 ? nodes : 1;
+      }();
+
+      return count;
+    }
+
+    int currentNumaNode(int nodes)
+    {
+#ifdef __linux__
+      // tasking threads are not pinned and may migrate between nodes, so
+      // the CPU is asked every time (sched_getcpu() is a vDSO call) and
+      // only its node is looked up once per thread
+      static thread_local std::vector<int> nodeOf;
+      static thread_local int tableNodes = 0;
+
+      if (nodes != tableNodes) {
+        nodeOf.resize(cpuCount());
+        for (int cpu = 0; cpu < cpuCount(); ++cpu)
+          nodeOf[cpu] = nodeOfCpu(cpu, nodes);
+        tableNodes = nodes;
+      }
+
+      const int cpu = sched_getcpu();
+      return cpu >= 0 && cpu < int(nodeOf.size()) ? nodeOf[cpu] : 0;
+#else
+      return 0;
+#endif
+    }
+
+    void runOnNumaNode(int node, int nodes, const std::function<void()> &f)
+    {
+      std::exception_ptr error;
+
+      std::thread worker([&]() {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < cpuCount(); ++cpu) {
+          if (nodeOfCpu(cpu, nodes) == node)
+            CPU_SET(cpu, &set);
+        }
+        sched_setaffinity(0, sizeof(set), &set);
+#endif
+        try {
+          f();
+        } catch (...) {
+          error = std::current_exception();
+        }
+      });
+
+      worker.join();
+
+      if (error)
+        std::rethrow_exception(error);
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,46 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include <functional>
+
+namespace ospray {
+  namespace brlcad {
+
+    // NUMA placement /////////////////////////////////////////////////////////
+
+    // NOTE: 'nodes' is what the caller replicates over. When it matches the
+    //       machine's NUMA node count, CPUs map to their real nodes; any other
+    //       count splits the CPUs into that many equal groups, which keeps
+    //       the replication paths testable on a single node machine.
+
+    /*! NUMA nodes of this machine (1 if it cannot tell) */
+    int numaNodeCount();
+
+    /*! The node (in [0, nodes)) of the CPU the calling thread runs on right
+        now */
+    int currentNumaNode(int nodes);
+
+    /*! Run 'f' on a new thread bound to the CPUs of 'node' and wait for it;
+        memory it first touches (and that of threads it starts, which
+        inherit the binding) ends up local to that node. Rethrows what 'f'
+        throws. */
+    void runOnNumaNode(int node, int nodes, const std::function<void()> &f);
+
+  } // ::ospray::brlcad
+} // ::ospray
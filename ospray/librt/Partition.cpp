@@ -0,0 +1,150 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#include "Partition.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      /*! Costs each combination once, however often it is referenced */
+      struct CostWalker
+      {
+        db_i *dbip;
+        std::map<std::string, double> combCost;
+
+        double cost(directory *dp)
+        {
+          if (!(dp->d_flags & RT_DIR_COMB))
+            return 1.0 + dp->d_len / 4096.0;
+
+          auto found = combCost.find(dp->d_namep);
+          if (found != combCost.end())
+            return found->second;
+
+          rt_db_internal intern;
+          int read;
+          {
+            std::lock_guard<std::mutex> lock(librtMutex());
+            read = rt_db_get_internal(&intern, dp, dbip, nullptr,
+                                      &rt_uniresource);
+          }
+          if (read < 0) {
+            throw std::runtime_error(std::string("BRLCAD: could not read '")
+                                     + dp->d_namep + "'");
+          }
+
+          // cycles are broken by counting a combination as free while its
+          // own subtree is walked
+          combCost[dp->d_namep] = 0.0;
+
+          auto *comb = static_cast<rt_comb_internal*>(intern.idb_ptr);
+          const double total = treeCost(comb->tree);
+          {
+            std::lock_guard<std::mutex> lock(librtMutex());
+            rt_db_free_internal(&intern);
+          }
+
+          combCost[dp->d_namep] = total;
+          return total;
+        }
+
+        double treeCost(const union tree *tp)
+        {
+          if (tp == nullptr)
+            return 0.0;
+
+          if (tp->tr_op == OP_DB_LEAF) {
+            auto *dp = db_lookup(dbip, tp->tr_l.tl_name, LOOKUP_QUIET);
+            return dp != RT_DIR_NULL ? cost(dp) : 0.0;
+          }
+
+          return treeCost(tp->tr_b.tb_left) + treeCost(tp->tr_b.tb_right);
+        }
+      };
+
+    } // ::ospray::brlcad::{anonymous}
+
+    std::vector<double> estimatePrepCost(const Database &database,
+                                         const std::vector<std::string> &objects)
+    {
+      CostWalker walker {database.dbip, {}};
+
+      std::vector<double> costs;
+      for (const auto &obj : objects) {
+        auto *dp = db_lookup(database.dbip, obj.c_str(), LOOKUP_QUIET);
+        if (dp == RT_DIR_NULL) {
+          throw std::runtime_error("BRLCAD: no object '" + obj + "' in "
+                                   + database.filename);
+        }
+        costs.push_back(walker.cost(dp));
+      }
+
+      return costs;
+    }
+
+    std::vector<size_t> partitionObjects(const std::vector<double> &costs,
+                                         int rank,
+                                         int numRanks)
+    {
+      std::vector<size_t> order(costs.size());
+      std::iota(order.begin(), order.end(), 0);
+
+      // ties keep list order, so every rank sorts the same way
+      std::stable_sort(order.begin(), order.end(),
+                       [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+      std::vector<double> load(std::max(1, numRanks), 0.0);
+      std::vector<size_t> share;
+
+      for (size_t i : order) {
+        const int least = std::min_element(load.begin(), load.end())
+                          - load.begin();
+        load[least] += costs[i];
+        if (least == rank)
+          share.push_back(i);
+      }
+
+      std::sort(share.begin(), share.end());
+      return share;
+    }
+
+    std::vector<std::string> rankObjects(const Database &database,
+                                         const std::vector<std::string> &objects,
+                                         int rank,
+                                         int numRanks)
+    {
+      if (numRanks < 2)
+        return objects;
+
+      std::vector<std::string> share;
+      for (size_t i : partitionObjects(estimatePrepCost(database, objects),
+                                       rank, numRanks)) {
+        share.push_back(objects[i]);
+      }
+
+      return share;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,49 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+
+#pragma once
+
+#include "Scene.h"
+
+namespace ospray {
+  namespace brlcad {
+
+    // Data-parallel rendering: splitting objects over ranks //////////////////
+
+    /*! Rough prep cost of each of 'objects', read from the database without
+        prepping anything: one unit per primitive instance below the object,
+        plus one per 4 kB of the primitive's stored size, since BoTs, NMG
+        and other large primitives take longest to prep */
+    std::vector<double> estimatePrepCost(const Database &database,
+                                         const std::vector<std::string> &objects);
+
+    /*! Indices (ascending) of the objects 'rank' of 'numRanks' gets when
+        'costs' are balanced longest first onto the least loaded rank (LPT
+        scheduling). Every rank computes the same split on its own. */
+    std::vector<size_t> partitionObjects(const std::vector<double> &costs,
+                                         int rank,
+                                         int numRanks);
+
+    /*! The share of 'objects' of 'rank' of 'numRanks' (all of them if
+        'numRanks' is below 2) */
+    std::vector<std::string> rankObjects(const Database &database,
+                                         const std::vector<std::string> &objects,
+                                         int rank,
+                                         int numRanks);
+
+  } // ::ospray::brlcad
+} // ::ospray
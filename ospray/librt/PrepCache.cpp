@@ -0,0 +1,274 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "PrepCache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      constexpr uint64_t HASH_SEED = 0x9e3779b97f4a7c15ull;
+
+      inline uint64_t mix(uint64_t h, uint64_t v)
+      {
+        h ^= v + HASH_SEED + (h << 6) + (h >> 2);
+        h *= 0xff51afd7ed558ccdull;
+        return h ^ (h >> 33);
+      }
+
+      uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t h)
+      {
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+          uint64_t v;
+          std::memcpy(&v, data + i, sizeof(v));
+          h = mix(h, v);
+        }
+        for (; i < size; ++i)
+          h = mix(h, data[i]);
+        return mix(h, size);
+      }
+
+      uint64_t hashDouble(double d, uint64_t h)
+      {
+        uint64_t v;
+        std::memcpy(&v, &d, sizeof(v));
+        return mix(h, v);
+      }
+
+      uint64_t hashString(const std::string &s, uint64_t h)
+      {
+        return hashBytes((const unsigned char *)s.data(), s.size(), h);
+      }
+
+      std::string toHex(uint64_t v)
+      {
+        char buf[17];
+        std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+        return buf;
+      }
+
+      void makeDirectories(const std::string &path)
+      {
+        for (size_t pos = 1; pos != std::string::npos; ) {
+          pos = path.find('/', pos + 1);
+          const auto dir = path.substr(0, pos);
+          if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            throw std::runtime_error("BRLCAD: could not create " + dir);
+        }
+      }
+
+      /*! The content hash of 'filename', remembered in 'directory' by path,
+          size and modification time so unchanged databases are only read
+          once */
+      uint64_t cachedFileHash(const std::string &directory,
+                              const std::string &filename)
+      {
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0)
+          throw std::runtime_error("BRLCAD: could not stat " + filename);
+
+        const std::string memo = directory + "/file-hashes";
+
+        std::ifstream in(memo);
+        std::string line;
+        while (std::getline(in, line)) {
+          std::istringstream fields(line);
+          long long size, mtime;
+          std::string hash, path;
+          fields >> size >> mtime >> hash;
+          std::getline(fields >> std::ws, path);
+          if (path == filename && size == (long long)st.st_size &&
+              mtime == (long long)st.st_mtime) {
+            return std::strtoull(hash.c_str(), nullptr, 16);
+          }
+        }
+
+        const auto hash = hashFile(filename);
+
+        std::ofstream out(memo, std::ios::app);
+        out << (long long)st.st_size << ' ' << (long long)st.st_mtime << ' '
+            << toHex(hash) << ' ' << filename << '\n';
+
+        return hash;
+      }
+
+      // LIBRT_CACHE sharing ////////////////////////////////////////////////
+
+      std::mutex envMutex;
+      std::condition_variable envReleased;
+
+      /*! Loads between beginPrep() and endPrep(), and the LIBRT_CACHE they
+          want (empty: whatever the application set) */
+      int envHolders {0};
+      std::string envValue;
+
+      /*! The application's own LIBRT_CACHE, while 'envValue' replaces it */
+      bool hadPreviousEnv {false};
+      std::string previousEnv;
+
+      void acquireEnv(const std::string &value)
+      {
+        std::unique_lock<std::mutex> lock(envMutex);
+        envReleased.wait(lock, [&]() {
+          return envHolders == 0 || envValue == value;
+        });
+
+        if (envHolders++ > 0 || value.empty()) {
+          envValue = value;
+          return;
+        }
+
+        const char *env = getenv("LIBRT_CACHE");
+        hadPreviousEnv = env != nullptr;
+        if (hadPreviousEnv)
+          previousEnv = env;
+
+        setenv("LIBRT_CACHE", value.c_str(), 1);
+        envValue = value;
+      }
+
+      void releaseEnv()
+      {
+        {
+          std::lock_guard<std::mutex> lock(envMutex);
+          if (--envHolders > 0)
+            return;
+
+          if (!envValue.empty()) {
+            if (hadPreviousEnv)
+              setenv("LIBRT_CACHE", previousEnv.c_str(), 1);
+            else
+              unsetenv("LIBRT_CACHE");
+          }
+        }
+
+        envReleased.notify_all();
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    uint64_t hashFile(const std::string &filename)
+    {
+      const int fd = open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("BRLCAD: could not open " + filename);
+
+      struct stat st;
+      fstat(fd, &st);
+      const size_t size = st.st_size;
+
+      uint64_t hash = HASH_SEED;
+
+      if (size > 0) {
+        void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+          close(fd);
+          throw std::runtime_error("BRLCAD: could not map " + filename);
+        }
+        madvise(data, size, MADV_SEQUENTIAL);
+        hash = hashBytes((const unsigned char *)data, size, hash);
+        munmap(data, size);
+      }
+
+      close(fd);
+      return hash;
+    }
+
+    // PrepCache definitions //////////////////////////////////////////////////
+
+    PrepCache::PrepCache(const std::string &directory,
+                         const std::string &filename,
+                         const std::vector<std::string> &objects,
+                         const bn_tol &tol)
+    {
+      if (directory.empty())
+        return;
+
+      makeDirectories(directory);
+
+      // one directory for all objects of a database, so loads of several
+      // of them can share LIBRT_CACHE
+      uint64_t dirKey = cachedFileHash(directory, filename);
+      dirKey = hashDouble(tol.dist, dirKey);
+      dirKey = hashDouble(tol.perp, dirKey);
+
+      uint64_t key = dirKey;
+      for (const auto &obj : objects)
+        key = hashString(obj, key);
+
+      entryKey = toHex(key);
+      entry    = directory + "/" + toHex(dirKey);
+      manifest = entry + "/manifest-" + entryKey;
+
+      makeDirectories(entry);
+
+      wasHit = std::ifstream(manifest).good();
+    }
+
+    PrepCache::~PrepCache()
+    {
+      // commit() threw between beginPrep() and endPrep()
+      if (preparing)
+        releaseEnv();
+    }
+
+    void PrepCache::beginPrep()
+    {
+      acquireEnv(entry);
+      preparing = true;
+    }
+
+    void PrepCache::endPrep(const rt_i *rtip, double prepSeconds)
+    {
+      if (!preparing)
+        return;
+
+      releaseEnv();
+      preparing = false;
+
+      if (!enabled() || wasHit)
+        return;
+
+      std::ofstream out(manifest);
+      out << "ospray-brlcad-prep-cache 1\n"
+          << "bounds "
+          << rtip->mdl_min[0] << ' ' << rtip->mdl_min[1] << ' '
+          << rtip->mdl_min[2] << ' ' << rtip->mdl_max[0] << ' '
+          << rtip->mdl_max[1] << ' ' << rtip->mdl_max[2] << '\n'
+          << "solids " << rtip->nsolids << '\n'
+          << "regions " << rtip->nregions << '\n'
+          << "prepSeconds " << prepSeconds << '\n';
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
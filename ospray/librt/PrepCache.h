@@ -0,0 +1,87 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#undef UNUSED
+#undef _USE_MATH_DEFINES
+#include "brlcad/common.h"
+#include "brlcad/raytrace.h"	/* librt interface definitions */
+
+namespace ospray {
+  namespace brlcad {
+
+    /*! Content hash of a file, computed over a read-only memory map */
+    uint64_t hashFile(const std::string &filename);
+
+    /*! On-disk cache of prepped solid data for one (database contents,
+        object list, tolerances) combination.
+
+        librt (7.28 and later) already knows how to serialize and reload the
+        expensive parts of solid prep (BoT and brep acceleration data) into
+        the directory named by LIBRT_CACHE, keyed by each solid's contents;
+        this class gives every (database contents, tolerances) combination
+        its own directory below the user's cache directory, points librt at
+        it for the duration of tree walking and prep, and records a small
+        manifest per object list once its prep is complete so later commits
+        know it is a hit. The space partitioning itself is pointer based and
+        is always rebuilt by rt_prep.
+
+        NOTE: LIBRT_CACHE is process-wide and read all through a walk and
+              prep, so it is only ever changed while no load is running:
+              any number of loads that want the same value (all the objects
+              of one database, or loads without a cache, which leave it as
+              the application set it) run side by side, and a load that
+              wants another value waits for them. */
+    struct PrepCache
+    {
+      /*! An empty 'directory' disables the cache */
+      PrepCache(const std::string &directory,
+                const std::string &filename,
+                const std::vector<std::string> &objects,
+                const bn_tol &tol);
+
+      ~PrepCache();
+
+      bool enabled() const { return !entry.empty(); }
+      bool hit() const { return wasHit; }
+
+      const std::string &key() const { return entryKey; }
+
+      /*! Point librt at this entry (waiting for loads that want another
+          LIBRT_CACHE); call before rt_gettree(), also without a cache */
+      void beginPrep();
+
+      /*! Let LIBRT_CACHE go (it is restored once the last load using it is
+          done) and record the finished entry */
+      void endPrep(const rt_i *rtip, double prepSeconds);
+
+    private:
+
+      std::string entry;
+      std::string entryKey;
+      std::string manifest;
+
+      bool wasHit {false};
+      bool preparing {false};
+    };
+
+  } // ::ospray::brlcad
+} // ::ospray
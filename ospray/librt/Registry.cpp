@@ -0,0 +1,237 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Registry.h"
+
+#include "ospcommon/tasking/parallel_for.h"
+#include "ospcommon/tasking/tasking_system_handle.h"
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      /*! (filename, object, has proxy, abs, rel, norm) */
+      using SceneKey =
+          std::tuple<std::string, std::string, bool, double, double, double>;
+
+      std::mutex registryMutex;
+
+      std::map<std::string, std::weak_ptr<Database>> databases;
+      std::map<SceneKey, std::weak_ptr<Scene>> scenes;
+
+      /*! Scenes being constructed right now */
+      std::map<SceneKey, std::shared_future<std::shared_ptr<Scene>>> loading;
+
+      std::shared_ptr<Database> lastDatabase;
+
+      SceneKey sceneKey(const Database &database,
+                        const std::string &object,
+                        const rt_tess_tol *proxyTol)
+      {
+        if (!proxyTol)
+          return SceneKey(database.filename, object, false, 0.0, 0.0, 0.0);
+
+        return SceneKey(database.filename, object, true,
+                        proxyTol->abs, proxyTol->rel, proxyTol->norm);
+      }
+
+      /*! Any live scene of 'object', whatever its proxy tolerances */
+      std::shared_ptr<Scene> lockedFindScene(const std::string &filename,
+                                             const std::string &object)
+      {
+        auto found = scenes.lower_bound(SceneKey(filename, object, false,
+                                                 0.0, 0.0, 0.0));
+        for (; found != scenes.end() && std::get<0>(found->first) == filename
+               && std::get<1>(found->first) == object; ++found) {
+          if (auto scene = found->second.lock())
+            return scene;
+        }
+
+        return nullptr;
+      }
+
+      std::shared_ptr<Database> lockedAcquireDatabase(const std::string &filename)
+      {
+        auto database = databases[filename].lock();
+        if (!database) {
+          database = std::make_shared<Database>(filename);
+          databases[filename] = database;
+        }
+
+        lastDatabase = database;
+        return database;
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    std::shared_ptr<Database> acquireDatabase(const std::string &filename)
+    {
+      std::lock_guard<std::mutex> lock(registryMutex);
+      return lockedAcquireDatabase(filename);
+    }
+
+    std::shared_ptr<Scene> acquireScene(std::shared_ptr<Database> database,
+                                        const std::string &object,
+                                        const std::string &prepCacheDir,
+                                        const rt_tess_tol *proxyTol,
+                                        bool *created,
+                                        int threads)
+    {
+      std::unique_lock<std::mutex> lock(registryMutex);
+
+      const auto key = sceneKey(*database, object, proxyTol);
+
+      if (created)
+        *created = false;
+
+      if (auto scene = scenes[key].lock())
+        return scene;
+
+      auto inFlight = loading.find(key);
+      if (inFlight != loading.end()) {
+        auto future = inFlight->second;
+        lock.unlock();
+        return future.get();
+      }
+
+      std::promise<std::shared_ptr<Scene>> promise;
+      loading[key] = promise.get_future().share();
+      lock.unlock();
+
+      std::shared_ptr<Scene> scene;
+      try {
+        scene = std::make_shared<Scene>(database,
+                                        std::vector<std::string>{object},
+                                        prepCacheDir,
+                                        proxyTol,
+                                        threads);
+      } catch (...) {
+        lock.lock();
+        loading.erase(key);
+        promise.set_exception(std::current_exception());
+        throw;
+      }
+
+      lock.lock();
+      scenes[key] = scene;
+      loading.erase(key);
+      promise.set_value(scene);
+
+      if (created)
+        *created = true;
+
+      return scene;
+    }
+
+    std::vector<std::shared_ptr<Scene>>
+    acquireScenes(std::shared_ptr<Database> database,
+                  const std::vector<std::string> &objects,
+                  const std::string &prepCacheDir,
+                  const rt_tess_tol *proxyTol,
+                  const SceneAcquired &acquired,
+                  const SceneFailed &failed)
+    {
+      std::vector<std::shared_ptr<Scene>> result(objects.size());
+
+      // objects loading side by side share the threads librt's own walk and
+      // prep would otherwise each use in full; they all want the same
+      // LIBRT_CACHE, so it is set once for the lot (see PrepCache)
+      const int numThreads = tasking::numTaskingThreads();
+      const int concurrent =
+          std::max<int>(1, std::min<int>(numThreads, objects.size()));
+      const int threads = std::max(1, numThreads / concurrent);
+
+      std::mutex errorMutex;
+      std::string error;
+
+      tasking::parallel_for(objects.size(), [&](size_t i) {
+        try {
+          bool created = false;
+          result[i] = acquireScene(database, objects[i], prepCacheDir,
+                                   proxyTol, &created, threads);
+          if (acquired)
+            acquired(i, result[i], created);
+        } catch (const std::exception &e) {
+          if (failed) {
+            failed(i, e.what());
+            return;
+          }
+
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (error.empty())
+            error = "'" + objects[i] + "': " + e.what();
+        }
+      });
+
+      if (!error.empty())
+        throw std::runtime_error("BRLCAD: could not load " + error);
+
+      return result;
+    }
+
+    std::shared_ptr<Scene> lookupScene(const Database &database,
+                                       const std::string &object,
+                                       const rt_tess_tol *proxyTol)
+    {
+      std::lock_guard<std::mutex> lock(registryMutex);
+
+      auto found = scenes.find(sceneKey(database, object, proxyTol));
+      return found != scenes.end() ? found->second.lock() : nullptr;
+    }
+
+    box3f queryBounds(const std::string &filename,
+                      const std::vector<std::string> &objects)
+    {
+      std::lock_guard<std::mutex> lock(registryMutex);
+
+      auto database = lockedAcquireDatabase(filename);
+
+      box3f bounds = empty;
+
+      for (const auto &obj : objects) {
+        // any prepped scene of this object has exact bounds already
+        if (auto scene = lockedFindScene(filename, obj)) {
+          bounds.extend(scene->bounds);
+          continue;
+        }
+
+        auto *dp = db_lookup(database->dbip, obj.c_str(), LOOKUP_QUIET);
+        if (dp == RT_DIR_NULL)
+          throw std::runtime_error("BRLCAD: no object '" + obj + "' in "
+                                   + filename);
+
+        point_t objMin, objMax;
+        std::lock_guard<std::mutex> librt(librtMutex());
+        if (rt_bound_internal(database->dbip, dp, objMin, objMax) < 0)
+          throw std::runtime_error("BRLCAD: could not bound '" + obj + "'");
+
+        bounds.extend(vec3f(objMin[0], objMin[1], objMin[2]));
+        bounds.extend(vec3f(objMax[0], objMax[1], objMax[2]));
+      }
+
+      return bounds;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
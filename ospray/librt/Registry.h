@@ -0,0 +1,91 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "Scene.h"
+
+#include <functional>
+
+namespace ospray {
+  namespace brlcad {
+
+    // Process-wide sharing of opened databases and prepped scenes ////////////
+
+    // NOTE: scenes are loaded outside the registry lock, so different objects
+    //       load concurrently; asking for a scene that is being loaded waits
+    //       for that load instead of starting another one.
+
+    // NOTE: a scene that fails to load is not remembered, so asking for it
+    //       again (say, on the next commit) tries to load it again.
+
+    // NOTE: the registry only holds weak references, so a Database or Scene
+    //       lives exactly as long as some geometry (or caller) uses it; the
+    //       one exception is the most recently opened Database, which is kept
+    //       open so a bounds query followed by a geometry commit (the usual
+    //       viewer startup) only reads the .g directory once.
+
+    /*! The opened Database for 'filename', shared with every other user */
+    std::shared_ptr<Database> acquireDatabase(const std::string &filename);
+
+    /*! The prepped Scene for 'object' of 'database', keyed by (filename,
+        object, proxy tolerances). A null 'proxyTol' asks for a scene without
+        a hybrid mode proxy. If 'created' is given it is set to whether the
+        scene had to be loaded (rather than being shared). */
+    std::shared_ptr<Scene> acquireScene(std::shared_ptr<Database> database,
+                                        const std::string &object,
+                                        const std::string &prepCacheDir,
+                                        const rt_tess_tol *proxyTol,
+                                        bool *created = nullptr,
+                                        int threads = 0);
+
+    /*! Called by acquireScenes() as each object is acquired, from whichever
+        thread acquired it */
+    using SceneAcquired = std::function<void(size_t index,
+                                             const std::shared_ptr<Scene> &,
+                                             bool created)>;
+
+    /*! Called by acquireScenes() for each object that could not be loaded,
+        from whichever thread attempted it */
+    using SceneFailed = std::function<void(size_t index,
+                                           const std::string &error)>;
+
+    /*! acquireScene() for each of 'objects', loading them concurrently on
+        the tasking system; throws the first error once all are attempted,
+        unless 'failed' is given, which is told about every error instead
+        (and the object's entry in the result left null) */
+    std::vector<std::shared_ptr<Scene>>
+    acquireScenes(std::shared_ptr<Database> database,
+                  const std::vector<std::string> &objects,
+                  const std::string &prepCacheDir,
+                  const rt_tess_tol *proxyTol,
+                  const SceneAcquired &acquired = nullptr,
+                  const SceneFailed &failed = nullptr);
+
+    /*! The Scene acquireScene() would share for these arguments, or null if
+        it would have to be loaded */
+    std::shared_ptr<Scene> lookupScene(const Database &database,
+                                       const std::string &object,
+                                       const rt_tess_tol *proxyTol);
+
+    /*! Bounds of 'objects' without prepping them: taken from an already
+        prepped Scene when one is registered, otherwise computed from the
+        primitives' own bounding boxes and booleans by rt_bound_internal() */
+    box3f queryBounds(const std::string &filename,
+                      const std::vector<std::string> &objects);
+
+  } // ::ospray::brlcad
+} // ::ospray
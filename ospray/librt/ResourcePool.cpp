@@ -0,0 +1,247 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "ResourcePool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace ospray {
+  namespace brlcad {
+
+    // Thread slot allocation /////////////////////////////////////////////////
+
+    namespace {
+
+      std::mutex slotMutex;
+      std::vector<int> freeSlots;
+      int nextSlot {0};
+
+      struct ThreadSlot
+      {
+        ThreadSlot()
+        {
+          std::lock_guard<std::mutex> lock(slotMutex);
+          if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+          } else {
+            if (nextSlot == ResourcePool::MAX_SLOTS)
+              throw std::runtime_error("BRLCAD: out of librt resource slots");
+            index = nextSlot++;
+          }
+        }
+
+        ~ThreadSlot()
+        {
+          std::lock_guard<std::mutex> lock(slotMutex);
+          freeSlots.push_back(index);
+        }
+
+        int index {0};
+      };
+
+      LibrtStats readStats(const resource &res)
+      {
+        LibrtStats stats;
+        stats.shootrays   = res.re_nshootray;
+        stats.modelMisses = res.re_nmiss_model;
+        stats.solidShots  = res.re_shots;
+        stats.solidHits   = res.re_shot_hit;
+        stats.solidMisses = res.re_shot_miss;
+        stats.prunedRPP   = res.re_prune_solrpp;
+        stats.duplicates  = res.re_ndup;
+        stats.emptyCells  = res.re_nempty_cells;
+        stats.pieceShots  = res.re_piece_shots;
+        return stats;
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    int threadSlot()
+    {
+      static thread_local ThreadSlot slot;
+      return slot.index;
+    }
+
+    // ResourcePool definitions ///////////////////////////////////////////////
+
+    ResourcePool::~ResourcePool()
+    {
+      for (auto &chunk : chunks)
+        delete [] chunk.load();
+    }
+
+    void ResourcePool::reset(rt_i *_rtip, int preallocate)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      rtip = _rtip;
+
+      for (auto &chunk : chunks) {
+        auto *slots = chunk.load();
+        if (slots == nullptr)
+          continue;
+        for (int i = 0; i < CHUNK_SIZE; ++i)
+          slots[i].initialized = false;
+      }
+
+      const int nChunks = std::min(MAX_CHUNKS,
+                                   (preallocate + CHUNK_SIZE - 1) / CHUNK_SIZE);
+      for (int i = 0; i < nChunks; ++i)
+        allocateChunk(i);
+    }
+
+    size_t ResourcePool::memoryUsage() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      size_t bytes = 0;
+      for (const auto &chunk : chunks) {
+        const auto *slots = chunk.load(std::memory_order_acquire);
+        if (slots == nullptr)
+          continue;
+
+        bytes += CHUNK_SIZE * sizeof(Slot);
+
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+          const auto &res = slots[i].res;
+          if (!slots[i].initialized)
+            continue;
+          bytes += res.re_seglen   * sizeof(seg)
+                 + res.re_partlen  * sizeof(partition)
+                 + res.re_boolslen * sizeof(union tree *);
+        }
+      }
+
+      return bytes;
+    }
+
+    void ResourcePool::trim()
+    {
+      // threads that own a slot pick this up in local()
+      trimEpoch.fetch_add(1, std::memory_order_relaxed);
+
+      // holding slotMutex keeps free slots from getting a new owner
+      std::lock_guard<std::mutex> slotLock(slotMutex);
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (int slot : freeSlots) {
+        auto *slots = chunks[slot / CHUNK_SIZE].load();
+        if (slots == nullptr)
+          continue;
+
+        auto &s = slots[slot % CHUNK_SIZE];
+        if (!s.initialized)
+          continue;
+
+        rt_clean_resource(rtip, &s.res);
+        s.initialized = false;
+
+        // initSlot() puts it back; until then librt has nothing to clean
+        if (rtip != nullptr)
+          BU_PTBL_SET(&rtip->rti_resources, slot, nullptr);
+      }
+    }
+
+    int ResourcePool::capacity() const
+    {
+      int nChunks = 0;
+      for (const auto &chunk : chunks)
+        nChunks += chunk.load(std::memory_order_relaxed) != nullptr;
+      return nChunks * CHUNK_SIZE;
+    }
+
+    void ResourcePool::accumulateStats(LibrtStats &totals, bool reset)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (auto &chunk : chunks) {
+        auto *slots = chunk.load(std::memory_order_acquire);
+        if (slots == nullptr)
+          continue;
+
+        for (int i = 0; i < CHUNK_SIZE; ++i) {
+          auto &s = slots[i];
+          if (!s.initialized)
+            continue;
+
+          const auto now = readStats(s.res);
+
+          const auto &base = s.baseline;
+          totals.shootrays   += now.shootrays   - base.shootrays;
+          totals.modelMisses += now.modelMisses - base.modelMisses;
+          totals.solidShots  += now.solidShots  - base.solidShots;
+          totals.solidHits   += now.solidHits   - base.solidHits;
+          totals.solidMisses += now.solidMisses - base.solidMisses;
+          totals.prunedRPP   += now.prunedRPP   - base.prunedRPP;
+          totals.duplicates  += now.duplicates  - base.duplicates;
+          totals.emptyCells  += now.emptyCells  - base.emptyCells;
+          totals.pieceShots  += now.pieceShots  - base.pieceShots;
+
+          if (reset)
+            s.baseline = now;
+        }
+      }
+    }
+
+    ResourcePool::Slot *ResourcePool::allocateChunk(int chunk)
+    {
+      auto *slots = chunks[chunk].load();
+      if (slots == nullptr) {
+        // value-initialize so librt sees zeroed resources, as it expects
+        slots = new Slot[CHUNK_SIZE]();
+        chunks[chunk].store(slots, std::memory_order_release);
+      }
+      return slots;
+    }
+
+    resource *ResourcePool::initSlot(int slot)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      auto &s = allocateChunk(slot / CHUNK_SIZE)[slot % CHUNK_SIZE];
+
+      const uint32_t epoch = trimEpoch.load(std::memory_order_relaxed);
+
+      // only the slot's own thread gets here for an initialized slot, so
+      // nothing else is using the resource while it is cleaned
+      if (s.initialized && s.trimEpoch != epoch) {
+        rt_clean_resource(rtip, &s.res);
+        s.initialized = false;
+      }
+
+      s.trimEpoch = epoch;
+
+      if (!s.initialized) {
+        // rt_init_resource() records the resource in rtip->rti_resources at
+        // index 'slot', so make sure the table is long enough for it
+        if (rtip != nullptr) {
+          while (BU_PTBL_LEN(&rtip->rti_resources) <= size_t(slot))
+            bu_ptbl_ins(&rtip->rti_resources, nullptr);
+        }
+
+        rt_init_resource(&s.res, slot, rtip);
+        s.baseline    = readStats(s.res);
+        s.initialized = true;
+      }
+
+      return &s.res;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
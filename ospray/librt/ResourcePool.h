@@ -0,0 +1,139 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#undef UNUSED
+#undef _USE_MATH_DEFINES
+#include "brlcad/common.h"
+#include "brlcad/raytrace.h"	/* librt interface definitions */
+
+namespace ospray {
+  namespace brlcad {
+
+    /*! Returns a small, dense index for the calling thread. The index is
+        handed out on the thread's first call and given back when the thread
+        exits, so a later thread reuses it (and with it the librt resources
+        already built for that index in every ResourcePool). */
+    int threadSlot();
+
+    /*! librt's own per-resource ray counters, summed over threads */
+    struct LibrtStats
+    {
+      uint64_t shootrays   {0}; //!< re_nshootray
+      uint64_t modelMisses {0}; //!< re_nmiss_model: missed the model RPP
+      uint64_t solidShots  {0}; //!< re_shots: ft_shot() calls
+      uint64_t solidHits   {0}; //!< re_shot_hit
+      uint64_t solidMisses {0}; //!< re_shot_miss
+      uint64_t prunedRPP   {0}; //!< re_prune_solrpp: solids skipped by RPP
+      uint64_t duplicates  {0}; //!< re_ndup: solids already shot this ray
+      uint64_t emptyCells  {0}; //!< re_nempty_cells: empty cells walked
+      uint64_t pieceShots  {0}; //!< re_piece_shots
+    };
+
+    /*! Per-thread librt 'resource' structs for one rt_i.
+
+        Slots are addressed by threadSlot() and live in fixed-size chunks
+        that are never moved once allocated (librt keeps pointers to them
+        in rt_i::rti_resources), so the pool can grow past its preallocated
+        size while other threads are tracing. rt_init_resource() is only
+        run the first time a thread actually shoots a ray. */
+    struct ResourcePool
+    {
+      ResourcePool() = default;
+      ~ResourcePool();
+
+      ResourcePool(const ResourcePool &) = delete;
+      ResourcePool &operator=(const ResourcePool &) = delete;
+
+      /*! Rebind the pool to 'rtip' (which may be null) and make sure slots
+          for at least 'preallocate' threads exist. Must not be called while
+          rays are in flight; resources are re-initialized lazily. */
+      void reset(rt_i *rtip, int preallocate);
+
+      /*! The calling thread's resource, initialized on first use. */
+      inline resource *local();
+
+      /*! Number of slots that currently have memory behind them. */
+      int capacity() const;
+
+      /*! Approximate bytes held by the pool: the slots themselves plus the
+          segment, partition and boolean stack free lists librt grew in
+          them. Read while threads may be tracing. */
+      size_t memoryUsage() const;
+
+      /*! Give the free lists back: slots of threads that have exited are
+          cleaned (rt_clean_resource()) now, every other slot is cleaned by
+          its own thread right before it next shoots a ray, so this is safe
+          to call while rendering. */
+      void trim();
+
+      /*! Add the librt counters of every slot to 'totals', counting from
+          the last call that asked to 'reset'. The counters are read while
+          their threads may still be tracing, so they are approximate. */
+      void accumulateStats(LibrtStats &totals, bool reset);
+
+      static constexpr int CHUNK_SIZE = 16;
+      static constexpr int MAX_CHUNKS = 1024;
+      static constexpr int MAX_SLOTS  = CHUNK_SIZE * MAX_CHUNKS;
+
+    private:
+
+      struct Slot
+      {
+        resource res;
+        bool initialized {false};
+        uint32_t trimEpoch {0};
+        LibrtStats baseline; //!< only touched while holding 'mutex'
+      };
+
+      Slot *allocateChunk(int chunk);
+      resource *initSlot(int slot);
+
+      rt_i *rtip {nullptr};
+
+      std::array<std::atomic<Slot*>, MAX_CHUNKS> chunks {};
+      mutable std::mutex mutex;
+
+      /*! Bumped by trim(); slots that saw an older value clean themselves */
+      std::atomic<uint32_t> trimEpoch {0};
+    };
+
+    // Inlined member functions ///////////////////////////////////////////////
+
+    inline resource *ResourcePool::local()
+    {
+      const int slot = threadSlot();
+
+      auto *chunk = chunks[slot / CHUNK_SIZE].load(std::memory_order_acquire);
+      if (chunk != nullptr) {
+        auto &s = chunk[slot % CHUNK_SIZE];
+        if (s.initialized &&
+            s.trimEpoch == trimEpoch.load(std::memory_order_relaxed)) {
+          return &s.res;
+        }
+      }
+
+      return initSlot(slot);
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,327 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Scene.h"
+#include "PrepCache.h"
+
+#include "ospray/api/ISPCDevice.h"
+
+#include "ospcommon/tasking/tasking_system_handle.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace ospray {
+  namespace brlcad {
+
+    static std::atomic<uint64_t> nextVersion {1};
+
+    static std::mutex liveMutex;
+    static std::set<Scene*> liveScenes;
+
+    static double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      return elapsed.count();
+    }
+
+    static void collectSolids(const union tree *tp,
+                              std::set<const soltab*> &solids)
+    {
+      if (tp == nullptr)
+        return;
+
+      switch (tp->tr_op) {
+      case OP_SOLID:
+        solids.insert(tp->tr_a.tu_stp);
+        break;
+      case OP_UNION:
+      case OP_INTERSECT:
+      case OP_SUBTRACT:
+      case OP_XOR:
+        collectSolids(tp->tr_b.tb_left, solids);
+        collectSolids(tp->tr_b.tb_right, solids);
+        break;
+      case OP_NOT:
+      case OP_GUARD:
+      case OP_XNOP:
+        collectSolids(tp->tr_b.tb_left, solids);
+        break;
+      default:
+        break;
+      }
+    }
+
+    // NOTE: librt keeps no tally of what prep allocates, so a solid counts
+    //       as its soltab plus twice its on-disk size (the prepped form of
+    //       most solids is a bit larger than the external one; BoTs
+    //       dominate either way), and a region as its struct plus tree.
+    //       The space partition is not counted.
+    static size_t estimatePrepBytes(const rt_i *rtip)
+    {
+      std::set<const soltab*> solids;
+      size_t bytes = 0;
+
+      for (size_t i = 0; i < rtip->nregions; ++i) {
+        auto *regp = rtip->Regions[i];
+        if (regp == REGION_NULL)
+          continue;
+        bytes += sizeof(region);
+        collectSolids(regp->reg_treetop, solids);
+      }
+
+      for (const auto *stp : solids) {
+        bytes += sizeof(soltab);
+        if (stp != nullptr && stp->st_dp != nullptr)
+          bytes += 2 * stp->st_dp->d_len;
+      }
+
+      bytes += sizeof(union tree) * 2 * solids.size();
+
+      return bytes;
+    }
+
+    std::mutex &librtMutex()
+    {
+      static std::mutex mutex;
+      return mutex;
+    }
+
+    // Database definitions ///////////////////////////////////////////////////
+
+    Database::Database(const std::string &_filename)
+      : filename(_filename)
+    {
+      if (filename.empty())
+        throw std::runtime_error("BRLCAD geometry requires a filename!");
+
+      const auto start = std::chrono::steady_clock::now();
+
+      dbip = db_open(filename.c_str(), DB_OPEN_READONLY);
+      if (dbip == DBI_NULL)
+        throw std::runtime_error("BRLCAD: could not open " + filename);
+
+      if (db_dirbuild(dbip) < 0) {
+        db_close(dbip);
+        throw std::runtime_error("BRLCAD: could not read the directory of "
+                                 + filename);
+      }
+
+      dirbuildSeconds = secondsSince(start);
+    }
+
+    Database::~Database()
+    {
+      db_close(dbip);
+    }
+
+    // Scene definitions //////////////////////////////////////////////////////
+
+    Scene::Scene(std::shared_ptr<Database> _database,
+                 const std::vector<std::string> &_objects,
+                 const std::string &prepCacheDir,
+                 const rt_tess_tol *proxyTol,
+                 int threads)
+      : database(_database),
+        objects(_objects)
+    {
+      // rt_new_rti() clones the db_i, so the rt_i holds its own reference
+      {
+        std::lock_guard<std::mutex> lock(librtMutex());
+        rtip = rt_new_rti(database->dbip);
+      }
+      if (rtip == RTI_NULL)
+        throw std::runtime_error("BRLCAD: could not create an rt_i for "
+                                 + database->filename);
+
+      if (threads <= 0)
+        threads = tasking::numTaskingThreads();
+
+      {
+        PrepCache prepCache(prepCacheDir, database->filename, objects,
+                            rtip->rti_tol);
+
+        const auto treeStart = std::chrono::steady_clock::now();
+        prepCache.beginPrep();
+
+        // rt_gettrees() walks the region subtrees of all objects in
+        // parallel, where rt_gettree() per object would walk them one by one
+        std::vector<const char*> argv;
+        for (const auto &obj : objects)
+          argv.push_back(obj.c_str());
+
+        rt_gettrees(rtip, argv.size(), argv.data(), threads);
+
+        treeSeconds = secondsSince(treeStart);
+
+        const auto prepStart = std::chrono::steady_clock::now();
+
+        rt_prep_parallel(rtip, threads);
+
+        prepSeconds = secondsSince(prepStart);
+
+        prepCache.endPrep(rtip, treeSeconds + prepSeconds);
+        prepCacheHit = prepCache.hit();
+      }
+
+      const auto resourceStart = std::chrono::steady_clock::now();
+
+      resources.reset(rtip, tasking::numTaskingThreads());
+
+      bounds.lower = vec3f(rtip->mdl_min[0], rtip->mdl_min[1], rtip->mdl_min[2]);
+      bounds.upper = vec3f(rtip->mdl_max[0], rtip->mdl_max[1], rtip->mdl_max[2]);
+
+      // Occlusion rays can skip boolean weaving if no region subtracts or
+      // intersects anything
+      unionsOnly = true;
+      for (size_t i = 0; i < rtip->nregions; ++i) {
+        auto *regp = rtip->Regions[i];
+        if (regp != REGION_NULL && !regp->reg_all_unions)
+          unionsOnly = false;
+      }
+
+      // Bound each region by its own boolean tree instead of the whole model
+      regionBounds.resize(rtip->nregions);
+      for (size_t i = 0; i < rtip->nregions; ++i) {
+        auto *regp = rtip->Regions[i];
+        point_t regMin, regMax;
+        if (regp == REGION_NULL ||
+            rt_bound_tree(regp->reg_treetop, regMin, regMax) < 0) {
+          VMOVE(regMin, rtip->mdl_min);
+          VMOVE(regMax, rtip->mdl_max);
+        }
+        auto &box = regionBounds[i];
+        box.lower = vec3f(regMin[0], regMin[1], regMin[2]);
+        box.upper = vec3f(regMax[0], regMax[1], regMax[2]);
+        box = intersectionOf(box, bounds);
+      }
+
+      resourceSeconds = secondsSince(resourceStart);
+
+      prepBytes = estimatePrepBytes(rtip);
+
+      if (proxyTol) {
+        buildProxy(*proxyTol);
+        prepBytes += proxyMesh.vertices.size() * sizeof(vec3f)
+                   + proxyMesh.triangles.size() * sizeof(vec3i);
+      }
+
+      version = nextVersion++;
+
+      std::lock_guard<std::mutex> lock(liveMutex);
+      liveScenes.insert(this);
+    }
+
+    Scene::~Scene()
+    {
+      {
+        std::lock_guard<std::mutex> lock(liveMutex);
+        liveScenes.erase(this);
+      }
+
+      if (proxyScene)
+        rtcDeleteScene(proxyScene);
+
+      // librt cleans up the pooled resources it knows about, so this has to
+      // happen before 'resources' goes away
+      if (rtip) {
+        std::lock_guard<std::mutex> lock(librtMutex());
+        rt_free_rti(rtip);
+      }
+    }
+
+    void Scene::matchRegions(const Scene &original)
+    {
+      std::unordered_map<std::string, uint32_t> originalBits;
+      for (size_t i = 0; i < original.rtip->nregions; ++i) {
+        auto *regp = original.rtip->Regions[i];
+        if (regp != REGION_NULL)
+          originalBits[regp->reg_name] = regp->reg_bit;
+      }
+
+      bool identity = true;
+
+      regionRemap.resize(rtip->nregions);
+      for (size_t i = 0; i < rtip->nregions; ++i) {
+        auto *regp = rtip->Regions[i];
+        auto found = regp != REGION_NULL ? originalBits.find(regp->reg_name)
+                                         : originalBits.end();
+        regionRemap[i] = found != originalBits.end() ? found->second : i;
+        identity = identity && regionRemap[i] == i;
+      }
+
+      if (identity)
+        regionRemap.clear();
+    }
+
+    void forEachLiveScene(const std::function<void(Scene &)> &f)
+    {
+      std::lock_guard<std::mutex> lock(liveMutex);
+
+      for (auto *scene : liveScenes)
+        f(*scene);
+    }
+
+    void Scene::buildProxy(const rt_tess_tol &ttol)
+    {
+      {
+        std::lock_guard<std::mutex> lock(librtMutex());
+        proxyMesh = tessellate(rtip, objects, ttol);
+      }
+
+      // facets may cut inside curved surfaces by up to the chord tolerance
+      // (the tighter of the absolute and the relative one), so the proxy is
+      // grown by that much to stay conservative
+      const float size = length(bounds.size());
+      const float relTol = ttol.rel > 0.0 ? float(ttol.rel) * size : 0.f;
+      const float absTol = ttol.abs > 0.0 ? float(ttol.abs) : 0.f;
+
+      if (relTol > 0.f && absTol > 0.f)
+        proxyDilation = std::min(relTol, absTol);
+      else if (relTol > 0.f || absTol > 0.f)
+        proxyDilation = std::max(relTol, absTol);
+      else
+        proxyDilation = 0.01f * size;
+
+      dilate(proxyMesh, proxyDilation);
+
+      // Embree reads vertices with 16 byte loads, so pad the last one
+      const size_t numTriangles = proxyMesh.triangles.size();
+      const size_t numVertices  = proxyMesh.vertices.size();
+      proxyMesh.vertices.push_back(vec3f(0.f));
+
+      auto device = (RTCDevice)ospray_getEmbreeDevice();
+      proxyScene  = rtcDeviceNewScene(device,
+                                      RTC_SCENE_STATIC | RTC_SCENE_ROBUST,
+                                      RTC_INTERSECT1);
+
+      auto meshID = rtcNewTriangleMesh2(proxyScene, RTC_GEOMETRY_STATIC,
+                                        numTriangles, numVertices);
+      rtcSetBuffer2(proxyScene, meshID, RTC_VERTEX_BUFFER,
+                    proxyMesh.vertices.data(), 0, sizeof(vec3f));
+      rtcSetBuffer2(proxyScene, meshID, RTC_INDEX_BUFFER,
+                    proxyMesh.triangles.data(), 0, sizeof(vec3i));
+      rtcCommit(proxyScene);
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,148 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "ospcommon/vec.h"
+#include "ospcommon/box.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#undef UNUSED
+#undef _USE_MATH_DEFINES
+#include "brlcad/common.h"
+#include "brlcad/vmath.h"		/* vector math macros */
+#include "brlcad/raytrace.h"	/* librt interface definitions */
+
+#include "embree2/rtcore.h"
+
+#include "ResourcePool.h"
+#include "Tessellate.h"
+
+namespace ospray {
+  namespace brlcad {
+
+    using namespace ospcommon;
+
+    // NOTE: librt keeps some of its state process-wide: rt_uniresource
+    //       (used by the tessellator and by plain database reads), the
+    //       BU_SETJUMP buffer NMG failures land in and the db_i reference
+    //       count rt_new_rti() and rt_free_rti() change. Whatever touches it
+    //       holds librtMutex(); tree walks and preps of separate rt_i still
+    //       run side by side. LIBRT_CACHE is handled by PrepCache.
+
+    /*! Serializes what touches librt's process-wide state */
+    std::mutex &librtMutex();
+
+    /*! A .g database opened and directory-built once; every Scene loaded
+        from it gets its own rt_i on top of the same db_i */
+    struct Database
+    {
+      Database(const std::string &filename);
+      ~Database();
+
+      Database(const Database &) = delete;
+      Database &operator=(const Database &) = delete;
+
+      std::string filename;
+      db_i *dbip {nullptr};
+
+      double dirbuildSeconds {0.0};
+    };
+
+    /*! One prepped rt_i over a set of top-level objects, plus everything
+        needed to trace it: the per-thread librt resources, region bounds
+        and (in hybrid mode) the tessellated proxy */
+    struct Scene
+    {
+      /*! A non-null 'proxyTol' also builds the hybrid mode proxy. The tree
+          walk and prep use 'threads' threads (0 for all tasking threads), so
+          scenes loaded side by side can split the machine between them. */
+      Scene(std::shared_ptr<Database> database,
+            const std::vector<std::string> &objects,
+            const std::string &prepCacheDir = "",
+            const rt_tess_tol *proxyTol = nullptr,
+            int threads = 0);
+      ~Scene();
+
+      Scene(const Scene &) = delete;
+      Scene &operator=(const Scene &) = delete;
+
+      std::shared_ptr<Database> database;
+      std::vector<std::string> objects;
+
+      rt_i *rtip {nullptr};
+
+      mutable ResourcePool resources;
+
+      box3f bounds;
+
+      /*! Tight bounds of each region, indexed by reg_bit */
+      std::vector<box3f> regionBounds;
+
+      /*! Every region is a pure union, so any librt segment is solid */
+      bool unionsOnly {false};
+
+      /*! Hybrid mode proxy: a triangle approximation traced by Embree */
+      RTCScene proxyScene {nullptr};
+      ProxyMesh proxyMesh;
+
+      /*! How far the proxy was grown outward (see dilate()); exact hits lie
+          up to about twice this behind a proxy hit */
+      float proxyDilation {0.f};
+
+      /*! Approximate memory held by the prepped rt_i (and the proxy): see
+          Scene.cpp for what is counted. Per-thread resources are accounted
+          by 'resources'. */
+      size_t prepBytes {0};
+
+      /*! Unique per Scene; keys the per-thread shot memos */
+      uint64_t version {0};
+
+      /*! Replicas (see matchRegions()): this scene's reg_bit to the reg_bit
+          of the same region in the scene it replicates; empty otherwise */
+      std::vector<uint32_t> regionRemap;
+
+      /*! Make this scene, prepped from the same objects as 'original',
+          report regions by the original's reg_bits. rt_gettrees() numbers
+          regions in the order its threads finish them, so two preps of the
+          same objects need not agree. */
+      void matchRegions(const Scene &original);
+
+      // Load statistics //
+
+      bool prepCacheHit {false};
+
+      double treeSeconds {0.0};      //!< rt_gettrees()
+      double prepSeconds {0.0};      //!< rt_prep_parallel()
+      double resourceSeconds {0.0};  //!< per-thread resources, region bounds
+
+    private:
+
+      void buildProxy(const rt_tess_tol &ttol);
+    };
+
+    /*! Call 'f' on every constructed Scene, whether it is shared through
+        the registry or private to a geometry (NUMA replicas, instancing
+        remainders); scenes are not destroyed while 'f' runs */
+    void forEachLiveScene(const std::function<void(Scene &)> &f);
+
+  } // ::ospray::brlcad
+} // ::ospray
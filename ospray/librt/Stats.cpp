@@ -0,0 +1,108 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Stats.h"
+#include "Scene.h"
+
+#include <mutex>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      // NOTE: like the thread slots they belong to, counters are kept for the
+      //       life of the process
+      std::atomic<ThreadStats*> threadStats[ResourcePool::MAX_SLOTS];
+
+      std::mutex collectMutex;
+      StatsSnapshot baseline = StatsSnapshot();
+      auto baselineTime = std::chrono::steady_clock::now();
+
+    } // ::ospray::brlcad::{anonymous}
+
+    ThreadStats &localStats()
+    {
+      static thread_local ThreadStats *stats = nullptr;
+
+      if (stats == nullptr) {
+        const int slot = threadSlot();
+        stats = threadStats[slot].load(std::memory_order_acquire);
+        if (stats == nullptr) {
+          stats = new ThreadStats;
+          threadStats[slot].store(stats, std::memory_order_release);
+        }
+      }
+
+      return *stats;
+    }
+
+    StatsSnapshot collectStats(bool reset)
+    {
+      std::lock_guard<std::mutex> lock(collectMutex);
+
+      StatsSnapshot now = StatsSnapshot();
+
+      for (auto &slot : threadStats) {
+        const auto *stats = slot.load(std::memory_order_acquire);
+        if (stats == nullptr)
+          continue;
+
+        for (int q = 0; q < 2; ++q) {
+          for (int w = 0; w < 4; ++w) {
+            now.calls[q][w] += stats->calls[q][w].get();
+            now.rays[q][w]  += stats->rays[q][w].get();
+          }
+          now.hits[q]   += stats->hits[q].get();
+          now.misses[q] += stats->misses[q].get();
+        }
+        now.shootrays  += stats->shootrays.get();
+        now.shootrayNs += stats->shootrayNs.get();
+      }
+
+      StatsSnapshot result = now;
+
+      for (int q = 0; q < 2; ++q) {
+        for (int w = 0; w < 4; ++w) {
+          result.calls[q][w] -= baseline.calls[q][w];
+          result.rays[q][w]  -= baseline.rays[q][w];
+        }
+        result.hits[q]   -= baseline.hits[q];
+        result.misses[q] -= baseline.misses[q];
+      }
+      result.shootrays  -= baseline.shootrays;
+      result.shootrayNs -= baseline.shootrayNs;
+
+      // librt keeps its own counters per resource; the pools track their
+      // baselines themselves since scenes come and go
+      forEachLiveScene([&](Scene &scene) {
+        scene.resources.accumulateStats(result.librt, reset);
+      });
+
+      const auto time = std::chrono::steady_clock::now();
+      result.seconds =
+          std::chrono::duration<double>(time - baselineTime).count();
+
+      if (reset) {
+        baseline     = now;
+        baselineTime = time;
+      }
+
+      return result;
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,107 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "ResourcePool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ospray {
+  namespace brlcad {
+
+    // Opt-in hot path counters ///////////////////////////////////////////////
+
+    enum StatsQuery { STATS_INTERSECT = 0, STATS_OCCLUDED = 1 };
+
+    /*! Index of an Embree callback width (1, 4, 8 or 16) in the counters */
+    inline int widthIndex(int width)
+    {
+      return width <= 1 ? 0 : width <= 4 ? 1 : width <= 8 ? 2 : 3;
+    }
+
+    /*! Counters of one thread slot. Only the owning thread writes them
+        (relaxed load + store, no read-modify-write), readers sum all slots
+        and subtract the values they saw at their last reset. Each slot's
+        counters are a separate allocation, so threads do not share them. */
+    struct ThreadStats
+    {
+      struct Counter
+      {
+        std::atomic<uint64_t> value {0};
+
+        inline void add(uint64_t n)
+        {
+          value.store(value.load(std::memory_order_relaxed) + n,
+                      std::memory_order_relaxed);
+        }
+
+        inline uint64_t get() const
+        {
+          return value.load(std::memory_order_relaxed);
+        }
+      };
+
+      Counter calls[2][4]; //!< [query][width index] callback invocations
+      Counter rays[2][4];  //!< [query][width index] valid rays
+      Counter hits[2];     //!< [query] hit (or occluded) rays
+      Counter misses[2];   //!< [query] rays that found nothing
+      Counter shootrays;   //!< rt_shootray() calls
+      Counter shootrayNs;  //!< time spent inside rt_shootray()
+    };
+
+    /*! The calling thread's counters */
+    ThreadStats &localStats();
+
+    /*! Times rt_shootray() into the calling thread's counters */
+    inline int timedShootray(application *ap)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      const int result = rt_shootray(ap);
+      const auto end   = std::chrono::steady_clock::now();
+
+      auto &stats = localStats();
+      stats.shootrays.add(1);
+      stats.shootrayNs.add(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+              .count());
+
+      return result;
+    }
+
+    /*! Totals over all threads, since the last reset */
+    struct StatsSnapshot
+    {
+      uint64_t calls[2][4];
+      uint64_t rays[2][4];
+      uint64_t hits[2];
+      uint64_t misses[2];
+      uint64_t shootrays;
+      uint64_t shootrayNs;
+
+      LibrtStats librt;
+
+      double seconds; //!< wall clock time covered by this snapshot
+    };
+
+    /*! Sum the counters of every thread, and the librt counters of every
+        loaded scene; with 'reset' the next snapshot starts from here */
+    StatsSnapshot collectStats(bool reset);
+
+  } // ::ospray::brlcad
+} // ::ospray
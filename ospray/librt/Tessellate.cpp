@@ -0,0 +1,279 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "Tessellate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace ospray {
+  namespace brlcad {
+
+    namespace {
+
+      struct TessState
+      {
+        rt_i *rtip;
+        ProxyMesh *mesh;
+        std::unordered_map<std::string, int> regionIDs;
+      };
+
+      void addTriangle(ProxyMesh &mesh,
+                       const vec3f &a,
+                       const vec3f &b,
+                       const vec3f &c)
+      {
+        const int base = mesh.vertices.size();
+        mesh.vertices.push_back(a);
+        mesh.vertices.push_back(b);
+        mesh.vertices.push_back(c);
+        mesh.triangles.push_back(vec3i(base, base + 1, base + 2));
+      }
+
+      void addBox(ProxyMesh &mesh, const vec3f &lo, const vec3f &hi)
+      {
+        const vec3f c[8] = {
+          vec3f(lo.x, lo.y, lo.z), vec3f(hi.x, lo.y, lo.z),
+          vec3f(lo.x, hi.y, lo.z), vec3f(hi.x, hi.y, lo.z),
+          vec3f(lo.x, lo.y, hi.z), vec3f(hi.x, lo.y, hi.z),
+          vec3f(lo.x, hi.y, hi.z), vec3f(hi.x, hi.y, hi.z)
+        };
+
+        static const int quads[6][4] = {
+          {0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4},
+          {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5}
+        };
+
+        for (const auto &q : quads) {
+          addTriangle(mesh, c[q[0]], c[q[1]], c[q[2]]);
+          addTriangle(mesh, c[q[0]], c[q[2]], c[q[3]]);
+        }
+      }
+
+      /*! Append the triangulated faces of an evaluated NMG region */
+      void addRegion(ProxyMesh &mesh, nmgregion *r)
+      {
+        shell *s;
+        for (BU_LIST_FOR(s, shell, &r->s_hd)) {
+          faceuse *fu;
+          for (BU_LIST_FOR(fu, faceuse, &s->fu_hd)) {
+            if (fu->orientation != OT_SAME)
+              continue;
+
+            loopuse *lu;
+            for (BU_LIST_FOR(lu, loopuse, &fu->lu_hd)) {
+              if (BU_LIST_FIRST_MAGIC(&lu->down_hd) != NMG_EDGEUSE_MAGIC)
+                continue;
+
+              vec3f v[3];
+              int n = 0;
+
+              edgeuse *eu;
+              for (BU_LIST_FOR(eu, edgeuse, &lu->down_hd)) {
+                if (n < 3) {
+                  const fastf_t *p = eu->vu_p->v_p->vg_p->coord;
+                  v[n] = vec3f(p[0], p[1], p[2]);
+                }
+                n++;
+              }
+
+              // nmg_triangulate_model() leaves only triangles behind
+              if (n == 3)
+                addTriangle(mesh, v[0], v[1], v[2]);
+            }
+          }
+        }
+      }
+
+      union tree *regionEnd(db_tree_state *tsp,
+                            const db_full_path *pathp,
+                            union tree *curtree,
+                            void *client_data)
+      {
+        auto &state = *static_cast<TessState*>(client_data);
+
+        if (curtree->tr_op == OP_NOP)
+          return curtree;
+
+        char *name = db_path_to_string(pathp);
+        auto found = state.regionIDs.find(name);
+        bu_free(name, "region path");
+
+        if (found == state.regionIDs.end()) {
+          db_free_tree(curtree, tsp->ts_resp);
+          return TREE_NULL;
+        }
+
+        const int region = found->second;
+        volatile bool evaluated = false;
+
+        // NMG reports failure by bombing, so catch that and fall back to the
+        // region's bounding box instead of taking the renderer down with it
+        if (!BU_SETJUMP) {
+          if (nmg_boolean(curtree, *tsp->ts_m, tsp->ts_tol, tsp->ts_resp) == 0
+              && curtree->tr_d.td_r != nullptr) {
+            nmg_triangulate_model(*tsp->ts_m, tsp->ts_tol);
+            addRegion(*state.mesh, curtree->tr_d.td_r);
+            evaluated = true;
+          }
+        }
+        BU_UNSETJUMP;
+
+        if (!evaluated) {
+          point_t regMin, regMax;
+          auto *regp = state.rtip->Regions[region];
+          if (rt_bound_tree(regp->reg_treetop, regMin, regMax) < 0) {
+            VMOVE(regMin, state.rtip->mdl_min);
+            VMOVE(regMax, state.rtip->mdl_max);
+          }
+          addBox(*state.mesh,
+                 vec3f(regMin[0], regMin[1], regMin[2]),
+                 vec3f(regMax[0], regMax[1], regMax[2]));
+          state.mesh->failedRegions++;
+        }
+
+        // start the next region from an empty model
+        nmg_km(*tsp->ts_m);
+        *tsp->ts_m = nmg_mm();
+
+        db_free_tree(curtree, tsp->ts_resp);
+        return TREE_NULL;
+      }
+
+    } // ::ospray::brlcad::{anonymous}
+
+    ProxyMesh tessellate(rt_i *rtip,
+                         const std::vector<std::string> &objects,
+                         const rt_tess_tol &ttol)
+    {
+      ProxyMesh mesh;
+
+      TessState state;
+      state.rtip = rtip;
+      state.mesh = &mesh;
+
+      for (size_t i = 0; i < rtip->nregions; ++i) {
+        auto *regp = rtip->Regions[i];
+        if (regp != REGION_NULL)
+          state.regionIDs[regp->reg_name] = regp->reg_bit;
+      }
+
+      std::vector<const char *> argv;
+      for (const auto &obj : objects)
+        argv.push_back(obj.c_str());
+
+      model *m = nmg_mm();
+
+      db_tree_state treeState = rt_initial_tree_state;
+      treeState.ts_tol  = &rtip->rti_tol;
+      treeState.ts_ttol = &ttol;
+      treeState.ts_m    = &m;
+      treeState.ts_resp = &rt_uniresource;
+
+      // NOTE: all regions share one NMG model, so walk with a single cpu
+      db_walk_tree(rtip->rti_dbip, argv.size(), argv.data(), 1, &treeState,
+                   nullptr, regionEnd, nmg_booltree_leaf_tess, &state);
+
+      nmg_km(m);
+
+      return mesh;
+    }
+
+    void dilate(ProxyMesh &mesh, float distance)
+    {
+      if (distance <= 0.f)
+        return;
+
+      // triangles do not share vertices, so corners are matched by position
+      struct PositionHash
+      {
+        size_t operator()(const vec3f &p) const
+        {
+          uint32_t b[3];
+          std::memcpy(b, &p, sizeof(b));
+          return b[0] * 73856093u ^ b[1] * 19349663u ^ b[2] * 83492791u;
+        }
+      };
+
+      struct PositionEqual
+      {
+        bool operator()(const vec3f &a, const vec3f &b) const
+        {
+          return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+      };
+
+      struct Corner
+      {
+        vec3f normalSum {0.f};
+        float minCos {1.f};
+      };
+
+      std::unordered_map<vec3f, Corner, PositionHash, PositionEqual> corners;
+
+      std::vector<vec3f> faceNormals(mesh.triangles.size(), vec3f(0.f));
+
+      for (size_t t = 0; t < mesh.triangles.size(); ++t) {
+        const auto &tri = mesh.triangles[t];
+        const vec3f &a = mesh.vertices[tri.x];
+        const vec3f &b = mesh.vertices[tri.y];
+        const vec3f &c = mesh.vertices[tri.z];
+
+        const vec3f n = cross(b - a, c - a);
+        const float len = length(n);
+        if (len == 0.f)
+          continue;
+
+        faceNormals[t] = n / len;
+        for (int k = 0; k < 3; ++k)
+          corners[mesh.vertices[tri[k]]].normalSum += faceNormals[t];
+      }
+
+      for (size_t t = 0; t < mesh.triangles.size(); ++t) {
+        if (faceNormals[t] == vec3f(0.f))
+          continue;
+
+        for (int k = 0; k < 3; ++k) {
+          auto &corner = corners[mesh.vertices[mesh.triangles[t][k]]];
+          const float len = length(corner.normalSum);
+          const float c = len > 0.f ? dot(corner.normalSum / len,
+                                          faceNormals[t]) : 0.f;
+          corner.minCos = std::min(corner.minCos, c);
+        }
+      }
+
+      // a corner moved along its mean normal by distance / cos(angle to a
+      // face) moves that face out by 'distance'; very sharp corners are
+      // capped at a few times that, and the two sides of a sheet cancel
+      // out and leave it in place
+      for (auto &v : mesh.vertices) {
+        auto found = corners.find(v);
+        if (found == corners.end())
+          continue;
+
+        const auto &corner = found->second;
+        const float len = length(corner.normalSum);
+        if (len == 0.f)
+          continue;
+
+        v += corner.normalSum / len
+             * (distance / std::max(corner.minCos, 0.25f));
+      }
+    }
+
+  } // ::ospray::brlcad
+} // ::ospray
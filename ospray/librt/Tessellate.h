@@ -0,0 +1,59 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+#include "ospcommon/vec.h"
+
+#include <string>
+#include <vector>
+
+#undef UNUSED
+#undef _USE_MATH_DEFINES
+#include "brlcad/common.h"
+#include "brlcad/raytrace.h"	/* librt interface definitions */
+
+namespace ospray {
+  namespace brlcad {
+
+    using namespace ospcommon;
+
+    /*! Triangle approximation of a set of BRL-CAD trees */
+    struct ProxyMesh
+    {
+      std::vector<vec3f> vertices;
+      std::vector<vec3i> triangles;
+
+      /*! Regions that NMG could not evaluate; they are represented by their
+          bounding box so the mesh stays a conservative stand-in */
+      int failedRegions {0};
+    };
+
+    /*! Tessellate the regions under 'objects' through NMG (the same path
+        g-stl and friends take); only regions prepped into 'rtip' are
+        included. */
+    ProxyMesh tessellate(rt_i *rtip,
+                         const std::vector<std::string> &objects,
+                         const rt_tess_tol &ttol);
+
+    /*! Push every vertex of 'mesh' outward so that each face moves by at
+        least 'distance'. Facets of curved surfaces lie inside them by up to
+        the tessellation tolerance; dilating by that much keeps rays that
+        graze a silhouette from missing the proxy. */
+    void dilate(ProxyMesh &mesh, float distance);
+
+  } // ::ospray::brlcad
+} // ::ospray
@@ -0,0 +1,219 @@
+// ======================================================================== //
+// Copyright 2009-2018 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+/* Plain C entry points exported by the 'brlcad' module, for applications
+   that talk to the module directly instead of only through OSPRay objects.
+   They are looked up at runtime after ospLoadModule("brlcad"), e.g.
+
+     auto queryBounds = (ospray_brlcad_query_bounds_t)
+         ospcommon::getSymbol("ospray_brlcad_query_bounds");
+
+   so applications do not need to link against the module. */
+
+#include "ospray/ospray.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Bounds of the comma separated 'objects' in 'filename', written to
+    'bounds' as (lower.xyz, upper.xyz). Does not prep the objects; the opened
+    database is kept for a geometry committed with the same file afterwards.
+    Returns 0 on success. */
+int ospray_brlcad_query_bounds(const char *filename,
+                               const char *objects,
+                               float *bounds);
+
+typedef int (*ospray_brlcad_query_bounds_t)(const char *, const char *,
+                                            float *);
+
+/*! Data-parallel rendering: bounds of the share of 'objects' that rank
+    'rank' of 'numRanks' loads when its geometry is committed with the same
+    "rank" and "numRanks" (objects are split by estimated prep cost), for
+    the rank's model region. An empty share gives a box of zero size at the
+    center of all objects' bounds, so the rank still has a valid region
+    that covers nothing. Returns 0 on success. */
+int ospray_brlcad_query_rank_bounds(const char *filename,
+                                    const char *objects,
+                                    int rank,
+                                    int numRanks,
+                                    float *bounds);
+
+typedef int (*ospray_brlcad_query_rank_bounds_t)(const char *, const char *,
+                                                 int, int, float *);
+
+/*! What a 'brlcad' geometry's hit primID refers to */
+typedef struct
+{
+  const char *name;      /*!< full path of the region, valid while loaded */
+  int regionID;          /*!< reg_regionid */
+  int aircode;           /*!< reg_aircode */
+  int materialID;        /*!< GIFT material code (reg_gmater) */
+  float color[3];        /*!< region color, or white if it has none */
+} ospray_brlcad_region;
+
+/*! Look up the region behind a hit's 'primID' on 'geometry', a committed
+    'brlcad' geometry of the local device, using the geometry's own region
+    numbering (which depends on its objects, "rank" share and instancing).
+    Returns 0 on success and 1 otherwise, including while the geometry is
+    being committed (ask again after the commit). */
+int ospray_brlcad_region_info(OSPGeometry geometry,
+                              unsigned int primID,
+                              ospray_brlcad_region *info);
+
+typedef int (*ospray_brlcad_region_info_t)(OSPGeometry, unsigned int,
+                                           ospray_brlcad_region *);
+
+/*! Where the load of a geometry's scenes went, summed over its scenes
+    (including those shared with other geometries, and NUMA replicas) */
+typedef struct
+{
+  double treeSeconds;            /*!< rt_gettrees() */
+  double prepSeconds;            /*!< rt_prep_parallel() */
+  double resourceSeconds;        /*!< per-thread resources, region bounds */
+  unsigned int scenes;
+  unsigned int prepCacheHits;    /*!< scenes prepped from the prep cache */
+} ospray_brlcad_load_stats;
+
+/*! Fill 'stats' for 'geometry', a committed 'brlcad' geometry of the local
+    device. Returns 0 on success and 1 otherwise, including while the
+    geometry is being committed. */
+int ospray_brlcad_get_load_stats(OSPGeometry geometry,
+                                 ospray_brlcad_load_stats *stats);
+
+typedef int (*ospray_brlcad_get_load_stats_t)(OSPGeometry,
+                                              ospray_brlcad_load_stats *);
+
+/*! Counters collected by 'brlcad' geometries committed with "stats" = 1,
+    summed over all threads and geometries. Widths are indexed 0..3 for
+    Embree's 1, 4, 8 and 16 wide callbacks; queries are 0 for intersect and
+    1 for occluded. */
+typedef struct
+{
+  unsigned long long calls[2][4];  /*!< callback invocations */
+  unsigned long long rays[2][4];   /*!< valid rays handed to callbacks */
+  unsigned long long hits[2];
+  unsigned long long misses[2];
+
+  unsigned long long shootrays;    /*!< rt_shootray() calls */
+  double shootraySeconds;          /*!< time spent in rt_shootray() */
+
+  /* librt's own per-resource counters, over all loaded objects */
+  unsigned long long librtShootrays;
+  unsigned long long modelMisses;  /*!< rays that missed the model RPP */
+  unsigned long long solidShots;   /*!< solid intersection tests */
+  unsigned long long solidHits;
+  unsigned long long solidMisses;
+  unsigned long long prunedRPP;    /*!< solids skipped by their RPP */
+  unsigned long long duplicates;   /*!< solids already tested on this ray */
+  unsigned long long emptyCells;   /*!< empty space partition cells walked */
+  unsigned long long pieceShots;
+
+  double seconds;                  /*!< wall clock time covered */
+} ospray_brlcad_stats;
+
+/*! Fill 'stats' with the counters since the last reset; a non-zero 'reset'
+    starts a new interval. Returns 0 on success. */
+int ospray_brlcad_get_stats(ospray_brlcad_stats *stats, int reset);
+
+/*! Post a summary of the counters since the last reset through the device's
+    status function, e.g. once per frame; a non-zero 'reset' starts a new
+    interval. */
+void ospray_brlcad_post_stats(int reset);
+
+typedef int (*ospray_brlcad_get_stats_t)(ospray_brlcad_stats *, int);
+typedef void (*ospray_brlcad_post_stats_t)(int);
+
+/*! Number of background loads started by geometries committed with
+    'async' that are still running. Committing such a geometry again once
+    this drops to 0 picks up the region table and region primitives. */
+size_t ospray_brlcad_pending_loads();
+
+typedef size_t (*ospray_brlcad_pending_loads_t)();
+
+/*! Tell geometries with a 'motionBudget' that the camera just moved; they
+    trace sparsely until the camera has been still for a moment */
+void ospray_brlcad_note_motion();
+
+typedef void (*ospray_brlcad_note_motion_t)();
+
+/*! 1 (once) when the camera has been still long enough for geometries that
+    traced sparsely to trace in full again. Frames accumulated while moving
+    are sparse, so the application should restart accumulation then. */
+int ospray_brlcad_motion_settled();
+
+typedef int (*ospray_brlcad_motion_settled_t)();
+
+/*! Account the memory of every 'brlcad' geometry (prepped scenes plus
+    librt's per-thread resources) and trim the resources of those over
+    their 'memoryCap'. With 'report' every geometry posts its numbers to
+    the status callback, otherwise only those that had to be trimmed. */
+void ospray_brlcad_account_memory(int report);
+
+typedef void (*ospray_brlcad_account_memory_t)(int);
+
+/*! Structure-of-arrays input for ospray_brlcad_shoot_batch() */
+typedef struct
+{
+  size_t count;
+  const float *orgx, *orgy, *orgz;
+  const float *dirx, *diry, *dirz;
+  const float *tnear;  /*!< optional, 0 if null */
+  const float *tfar;   /*!< optional, infinity if null */
+} ospray_brlcad_batch_rays;
+
+/*! Caller owned (possibly memory mapped) structure-of-arrays output of
+    ospray_brlcad_shoot_batch(). Every partition along a ray becomes one hit;
+    hits of a ray are contiguous and sorted by 'inDist', but rays are stored
+    in whatever order they finished. */
+typedef struct
+{
+  /* per ray, 'count' entries of ospray_brlcad_batch_rays */
+  unsigned int *first;         /*!< index of the ray's first hit */
+  unsigned int *numHits;       /*!< 0 if the ray missed (or did not fit) */
+
+  /* per hit, 'capacity' entries */
+  size_t capacity;
+  unsigned int *region;        /*!< region index, numbered like primIDs */
+  float *inDist, *outDist;     /*!< thickness is outDist - inDist */
+  float *inObliquity;          /*!< angle between ray and surface (radians) */
+  float *outObliquity;
+
+  /* filled in by the call */
+  size_t used;                 /*!< hits written */
+  size_t dropped;              /*!< rays whose hits did not fit */
+} ospray_brlcad_batch_hits;
+
+/*! Shoot all rays at 'objects' of 'filename' (loading them if no geometry
+    has yet) across the tasking system, recording every partition. Returns 0
+    on success, 1 on error and 2 if 'capacity' was too small for some rays
+    (see 'dropped'). */
+int ospray_brlcad_shoot_batch(const char *filename,
+                              const char *objects,
+                              const ospray_brlcad_batch_rays *rays,
+                              ospray_brlcad_batch_hits *hits);
+
+typedef int (*ospray_brlcad_shoot_batch_t)(const char *, const char *,
+                                           const ospray_brlcad_batch_rays *,
+                                           ospray_brlcad_batch_hits *);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -14,7 +14,22 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include "moduleAPI.h"
+#include "librt/AsyncLoad.h"
+#include "geometry/brlcad.h"
+#include "librt/Batch.h"
+#include "librt/Partition.h"
+#include "librt/Registry.h"
+#include "librt/Stats.h"
+
+#include "ospray/common/OSPCommon.h"
+
+#include "ospcommon/utility/StringManip.h"
+
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 namespace ospray {
   namespace brlcad {
@@ -23,7 +38,192 @@ namespace ospray {
     {
       std::cout << "#osp: initializing the 'brlcad' module" << std::endl;
     }
+
+    extern "C" int ospray_brlcad_query_bounds(const char *filename,
+                                              const char *objects,
+                                              float *bounds)
+    {
+      try {
+        const auto box = queryBounds(filename,
+                                     utility::split(objects, ','));
+        bounds[0] = box.lower.x;
+        bounds[1] = box.lower.y;
+        bounds[2] = box.lower.z;
+        bounds[3] = box.upper.x;
+        bounds[4] = box.upper.y;
+        bounds[5] = box.upper.z;
+        return 0;
+      } catch (const std::exception &e) {
+        std::cerr << "#osp:brlcad: " << e.what() << std::endl;
+        return 1;
+      }
+    }
     
+    extern "C" int ospray_brlcad_query_rank_bounds(const char *filename,
+                                                   const char *objects,
+                                                   int rank,
+                                                   int numRanks,
+                                                   float *bounds)
+    {
+      try {
+        auto db = acquireDatabase(filename);
+        const auto all   = utility::split(objects, ',');
+        const auto share = rankObjects(*db, all, rank, numRanks);
+
+        // an inverted (empty) box is no valid model region
+        box3f box;
+        if (share.empty()) {
+          const vec3f center = ospcommon::center(queryBounds(filename, all));
+          box = box3f(center, center);
+        } else {
+          box = queryBounds(filename, share);
+        }
+        bounds[0] = box.lower.x;
+        bounds[1] = box.lower.y;
+        bounds[2] = box.lower.z;
+        bounds[3] = box.upper.x;
+        bounds[4] = box.upper.y;
+        bounds[5] = box.upper.z;
+        return 0;
+      } catch (const std::exception &e) {
+        std::cerr << "#osp:brlcad: " << e.what() << std::endl;
+        return 1;
+      }
+    }
+
+    extern "C" int ospray_brlcad_region_info(OSPGeometry geometry,
+                                             unsigned int primID,
+                                             ospray_brlcad_region *info)
+    {
+      return BRLCAD::regionInfo(geometry, primID, *info) ? 0 : 1;
+    }
+
+    extern "C" int ospray_brlcad_get_load_stats(OSPGeometry geometry,
+                                                ospray_brlcad_load_stats *stats)
+    {
+      return BRLCAD::loadStats(geometry, *stats) ? 0 : 1;
+    }
+
+    extern "C" int ospray_brlcad_get_stats(ospray_brlcad_stats *stats,
+                                           int reset)
+    {
+      const auto snapshot = collectStats(reset);
+
+      for (int q = 0; q < 2; ++q) {
+        for (int w = 0; w < 4; ++w) {
+          stats->calls[q][w] = snapshot.calls[q][w];
+          stats->rays[q][w]  = snapshot.rays[q][w];
+        }
+        stats->hits[q]   = snapshot.hits[q];
+        stats->misses[q] = snapshot.misses[q];
+      }
+
+      stats->shootrays       = snapshot.shootrays;
+      stats->shootraySeconds = snapshot.shootrayNs * 1e-9;
+
+      stats->librtShootrays = snapshot.librt.shootrays;
+      stats->modelMisses    = snapshot.librt.modelMisses;
+      stats->solidShots     = snapshot.librt.solidShots;
+      stats->solidHits      = snapshot.librt.solidHits;
+      stats->solidMisses    = snapshot.librt.solidMisses;
+      stats->prunedRPP      = snapshot.librt.prunedRPP;
+      stats->duplicates     = snapshot.librt.duplicates;
+      stats->emptyCells     = snapshot.librt.emptyCells;
+      stats->pieceShots     = snapshot.librt.pieceShots;
+
+      stats->seconds = snapshot.seconds;
+
+      return 0;
+    }
+
+    extern "C" void ospray_brlcad_post_stats(int reset)
+    {
+      ospray_brlcad_stats stats;
+      ospray_brlcad_get_stats(&stats, reset);
+
+      static const char *queries[2] = {"intersect", "occluded"};
+      static const int widths[4] = {1, 4, 8, 16};
+
+      std::stringstream msg;
+      msg << std::fixed << std::setprecision(3)
+          << "#osp:brlcad: stats over " << stats.seconds << "s\n";
+
+      for (int q = 0; q < 2; ++q) {
+        const auto rays = stats.hits[q] + stats.misses[q];
+        if (rays == 0)
+          continue;
+
+        msg << "#osp:brlcad:   " << queries[q] << ": " << rays << " rays ("
+            << (100.0 * stats.hits[q] / rays) << "% hit), by width";
+        for (int w = 0; w < 4; ++w) {
+          if (stats.calls[q][w] > 0) {
+            msg << " x" << widths[w] << ": " << stats.rays[q][w] << " in "
+                << stats.calls[q][w] << " calls";
+          }
+        }
+        msg << "\n";
+      }
+
+      msg << "#osp:brlcad:   rt_shootray: " << stats.shootrays << " calls, "
+          << stats.shootraySeconds << "s thread time\n"
+          << "#osp:brlcad:   librt: " << stats.librtShootrays << " rays, "
+          << stats.modelMisses << " missed the model, "
+          << stats.solidShots << " solid tests (" << stats.solidHits
+          << " hit, " << stats.solidMisses << " missed), "
+          << stats.prunedRPP << " pruned by RPP, "
+          << stats.duplicates << " duplicates, "
+          << stats.emptyCells << " empty cells, "
+          << stats.pieceShots << " piece tests\n";
+
+      postStatusMsg(msg);
+    }
+
+    extern "C" size_t ospray_brlcad_pending_loads()
+    {
+      return pendingAsyncLoads();
+    }
+
+    extern "C" void ospray_brlcad_note_motion()
+    {
+      BRLCAD::noteAllMotion();
+    }
+
+    extern "C" int ospray_brlcad_motion_settled()
+    {
+      return BRLCAD::anyMotionSettled() ? 1 : 0;
+    }
+
+    extern "C" void ospray_brlcad_account_memory(int report)
+    {
+      BRLCAD::accountAllMemory(report);
+    }
+
+    extern "C" int ospray_brlcad_shoot_batch(const char *filename,
+                                             const char *objects,
+                                             const ospray_brlcad_batch_rays *rays,
+                                             ospray_brlcad_batch_hits *hits)
+    {
+      try {
+        // share (or load) a proxy-less scene per object, in primID order
+        auto database = acquireDatabase(filename);
+
+        std::vector<std::string> seen;
+        std::vector<std::shared_ptr<Scene>> scenes;
+        for (const auto &obj : utility::split(objects, ',')) {
+          if (std::find(seen.begin(), seen.end(), obj) != seen.end())
+            continue;
+          seen.push_back(obj);
+
+          scenes.push_back(acquireScene(database, obj, "", nullptr));
+        }
+
+        return shootBatch(scenes, *rays, *hits);
+      } catch (const std::exception &e) {
+        std::cerr << "#osp:brlcad: " << e.what() << std::endl;
+        return 1;
+      }
+    }
+
   } // ::ospray::brlcad
 } // ::ospray
   
\ No newline at end of file